@@ -0,0 +1,352 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * auxspi_sim.cpp: Simulated Slot 1 save chips with a simple timing model.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include "auxspi_sim.h"
+
+#include <nds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+using std::min;
+
+// Rough numbers taken from common datasheets (ST M45PE, 25xx eeproms).
+const AuxspiSimTiming auxspi_sim_default_timing = {
+    2000,       // byte (8 bits at 4 MHz)
+    5000000,    // eeprom_write
+    800000,     // flash_program
+    600000000,  // flash_erase
+    50000000,   // flash_erase_4k
+    120,        // delay
+    20000,      // ir_switch
+};
+
+static struct {
+  auxspi_sim_chip chip;
+  u32 size;
+  u8* mem;
+  u32 jedec;
+  bool infrared;
+  AuxspiSimTiming timing;
+  AuxspiSimStats stats;
+  // the current transaction
+  bool active;
+  bool slow;     // 1 MHz clock
+  bool ir;       // first byte goes to the IR bridge
+  u64 ir_ready;  // the bridge passes bytes through from this time on
+  bool mute;     // transaction not for the chip (or not understood by it)
+  u32 index;     // bytes of the transaction seen by the chip
+  u8 cmd;
+  u32 addr;
+  u32 addr_bytes;
+  // pending page program: data is collected and written at the end
+  u8 page[256];
+  bool page_used[256];
+  // chip state
+  bool wel;
+  u64 busy_until;
+} sim;
+
+// ---------------------------------------------------------
+//  local functions
+u32 sim_page_size() {
+  switch (sim.chip) {
+    case AUXSPI_SIM_EEPROM_512:
+      return 16;
+    case AUXSPI_SIM_EEPROM:
+      return 32;
+    case AUXSPI_SIM_FLASH:
+      return 256;
+    default:
+      return 0;  // FRAM has no pages
+  }
+}
+
+u32 sim_addr_bytes() {
+  if (sim.chip == AUXSPI_SIM_EEPROM_512) return 1;
+  return (sim.chip == AUXSPI_SIM_FLASH) ? 3 : 2;
+}
+
+bool sim_busy() { return sim.stats.elapsed < sim.busy_until; }
+
+u8 sim_status() {
+  u8 sr = (sim.chip == AUXSPI_SIM_EEPROM_512) ? 0xf0 : 0x00;
+  if (sim.wel) sr |= 0x02;
+  if (sim_busy()) sr |= 0x01;
+  return sr;
+}
+
+// Ends the current transaction; this is where writes and erases happen.
+void sim_end() {
+  if (!sim.active) return;
+  sim.active = false;
+  if (sim.mute || !sim.mem) return;
+
+  u32 page_size = sim_page_size();
+  switch (sim.cmd) {
+    case 0x06:
+      if (!sim_busy()) sim.wel = true;
+      break;
+    case 0x04:
+      sim.wel = false;
+      break;
+    case 0x02:
+      if (!sim.wel || (sim.index <= 1 + sim.addr_bytes)) break;
+      if (page_size) {
+        u32 base = sim.addr & ~(page_size - 1);
+        for (u32 i = 0; i < page_size; i++) {
+          if (!sim.page_used[i]) continue;
+          u32 a = (base + i) % sim.size;
+          // Flash can only clear bits
+          if (sim.chip == AUXSPI_SIM_FLASH)
+            sim.mem[a] &= sim.page[i];
+          else
+            sim.mem[a] = sim.page[i];
+        }
+        sim.stats.programs++;
+        sim.busy_until =
+            sim.stats.elapsed + ((sim.chip == AUXSPI_SIM_FLASH)
+                                     ? sim.timing.flash_program
+                                     : sim.timing.eeprom_write);
+      }
+      sim.wel = false;
+      break;
+    case 0xd8:
+    case 0x20:
+      if (!sim.wel || (sim.index < 4)) break;
+      {
+        bool small = (sim.cmd == 0x20);
+        u32 len = small ? 0x1000 : 0x10000;
+        u32 base = (sim.addr % sim.size) & ~(len - 1);
+        memset(sim.mem + base, 0xff, min(len, sim.size - base));
+        if (small) {
+          sim.stats.erases_4k++;
+          sim.busy_until = sim.stats.elapsed + sim.timing.flash_erase_4k;
+        } else {
+          sim.stats.erases++;
+          sim.busy_until = sim.stats.elapsed + sim.timing.flash_erase;
+        }
+      }
+      sim.wel = false;
+      break;
+  }
+}
+
+// local function: true if the chip knows the command
+bool sim_known_command(u8 cmd) {
+  bool flash = (sim.chip == AUXSPI_SIM_FLASH);
+  // the small eeprom keeps the upper address bit in the command
+  if (sim.chip == AUXSPI_SIM_EEPROM_512) {
+    if (((cmd & ~0x08) == 0x02) || ((cmd & ~0x08) == 0x03)) return !sim_busy();
+    if ((cmd != 0x05) && (cmd != 0x06) && (cmd != 0x04)) return false;
+  }
+  switch (cmd) {
+    case 0x05:
+      return true;
+    case 0x06:
+    case 0x04:
+    case 0x02:
+    case 0x03:
+      return !sim_busy();
+    case 0x9f:
+    case 0x0b:
+    case 0xd8:
+      return flash && !sim_busy();
+    case 0x20:
+      return flash && ((sim.jedec >> 16) == 0xc2) && !sim_busy();
+    default:
+      return false;
+  }
+}
+
+// local function: one byte seen by the chip
+u8 sim_chip_byte(u8 out) {
+  u32 i = sim.index++;
+  if (i == 0) {
+    sim.cmd = out;
+    sim.addr = 0;
+    sim.addr_bytes = sim_addr_bytes();
+    if (!sim_known_command(out)) {
+      sim.mute = true;
+      return 0xff;
+    }
+    if ((sim.chip == AUXSPI_SIM_EEPROM_512) && (out & 0x02)) {
+      sim.addr = (out & 0x08) << 5;
+      sim.cmd = out & ~0x08;
+    }
+    if (sim.cmd == 0x02) memset(sim.page_used, 0, sizeof(sim.page_used));
+    return 0xff;
+  }
+
+  switch (sim.cmd) {
+    case 0x05:
+      return sim_status();
+    case 0x9f:
+      return (i <= 3) ? (sim.jedec >> (8 * (3 - i))) & 0xff : 0xff;
+    case 0x03:
+    case 0x0b:
+    case 0x02:
+    case 0xd8:
+    case 0x20: {
+      u32 addr_bytes = (sim.cmd == 0x02 || sim.cmd == 0x03) ? sim.addr_bytes : 3;
+      if (i <= addr_bytes) {
+        sim.addr |= out << (8 * (addr_bytes - i));
+        return 0xff;
+      }
+      // FAST_READ has a dummy byte after the address
+      if ((sim.cmd == 0x0b) && (i == addr_bytes + 1)) return 0xff;
+      if ((sim.cmd == 0x03) || (sim.cmd == 0x0b)) {
+        u8 val = sim.mem ? sim.mem[sim.addr % sim.size] : 0xff;
+        sim.addr++;
+        return val;
+      }
+      if (sim.cmd == 0x02) {
+        u32 page_size = sim_page_size();
+        if (page_size) {
+          // data wraps around within the page
+          u32 p = sim.addr & (page_size - 1);
+          sim.page[p] = out;
+          sim.page_used[p] = true;
+          sim.addr = (sim.addr & ~(page_size - 1)) | ((p + 1) & (page_size - 1));
+        } else if (sim.wel && sim.mem) {
+          // FRAM writes right away
+          sim.mem[sim.addr % sim.size] = out;
+          sim.addr++;
+        }
+      }
+      return 0xff;
+    }
+  }
+  return 0xff;
+}
+
+// ---------------------------------------------------------
+//  transport functions
+void auxspi_sim_open(uint8 device) {
+  sim.slow = (device & 3) != 0;
+  if (sim.active) return;  // still the same transaction
+  sim.active = true;
+  sim.ir = sim.infrared;
+  sim.mute = false;
+  sim.index = 0;
+  sim.stats.transactions++;
+}
+
+uint8 auxspi_sim_transfer(uint8 out) {
+  sim.stats.bytes++;
+  sim.stats.elapsed += sim.slow ? 4 * sim.timing.byte : sim.timing.byte;
+  if (!sim.active || sim.mute) return 0xff;
+  if (sim.ir) {
+    // The IR bridge takes the first byte: 0 passes the rest through to the
+    //  save chip, anything else is a command for the bridge itself.
+    sim.ir = false;
+    if (out == 0) {
+      sim.stats.ir_switches++;
+      sim.ir_ready = sim.stats.elapsed + sim.timing.ir_switch;
+    } else {
+      sim.mute = true;
+    }
+    return 0x00;
+  }
+  // bytes sent while the bridge is still switching are lost
+  if (sim.infrared && (sim.index == 0) && (sim.stats.elapsed < sim.ir_ready)) {
+    sim.mute = true;
+    return 0xff;
+  }
+  return sim_chip_byte(out);
+}
+
+void auxspi_sim_close(bool lite) {
+  if (!lite) auxspi_sim_transfer(0);
+  sim_end();
+}
+
+void auxspi_sim_delay(uint32 count) {
+  sim.stats.elapsed += (u64)count * sim.timing.delay;
+}
+
+const AuxspiTransport auxspi_sim_transport = {
+    auxspi_sim_open, auxspi_sim_transfer, auxspi_sim_close, auxspi_sim_delay};
+
+// ---------------------------------------------------------
+bool auxspi_sim_init(auxspi_sim_chip chip, u32 size, u32 jedec, bool infrared,
+                     const AuxspiSimTiming* timing) {
+  auxspi_sim_shutdown();
+  if (chip == AUXSPI_SIM_EEPROM_512) size = 512;
+  if (!size) return false;
+
+  sim.mem = (u8*)malloc(size);
+  if (!sim.mem) return false;
+  memset(sim.mem, 0xff, size);
+  sim.chip = chip;
+  sim.size = size;
+  if (chip != AUXSPI_SIM_FLASH) {
+    // there is no JEDEC ID, the bus just floats
+    jedec = 0xffffff;
+  } else if (jedec == 0) {
+    u32 log2 = 0;
+    while ((1u << log2) < size) log2++;
+    jedec = 0x204000 | log2;
+  }
+  sim.jedec = jedec;
+  sim.infrared = infrared;
+  sim.timing = timing ? *timing : auxspi_sim_default_timing;
+  sim.active = false;
+  sim.wel = false;
+  sim.busy_until = 0;
+  auxspi_sim_reset_stats();
+
+  auxspi_set_transport(&auxspi_sim_transport);
+  return true;
+}
+
+void auxspi_sim_shutdown() {
+  if (auxspi_get_transport() == &auxspi_sim_transport)
+    auxspi_set_transport(NULL);
+  free(sim.mem);
+  sim.mem = NULL;
+}
+
+u8* auxspi_sim_memory() { return sim.mem; }
+
+const AuxspiSimStats* auxspi_sim_get_stats() { return &sim.stats; }
+
+void auxspi_sim_reset_stats() {
+  // the clock keeps running, so pending writes are not lost
+  u64 elapsed = sim.stats.elapsed;
+  memset(&sim.stats, 0, sizeof(sim.stats));
+  sim.busy_until = (sim.busy_until > elapsed) ? sim.busy_until - elapsed : 0;
+}
+
+void auxspi_sim_report(const char* workflow) {
+  iprintf("%s: %lu us\n", workflow, (unsigned long)(sim.stats.elapsed / 1000));
+  iprintf(" t:%lu b:%lu p:%lu e:%lu/%lu ir:%lu\n",
+          (unsigned long)sim.stats.transactions,
+          (unsigned long)sim.stats.bytes, (unsigned long)sim.stats.programs,
+          (unsigned long)sim.stats.erases, (unsigned long)sim.stats.erases_4k,
+          (unsigned long)sim.stats.ir_switches);
+  auxspi_sim_reset_stats();
+}
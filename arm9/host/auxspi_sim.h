@@ -0,0 +1,89 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * auxspi_sim.h: Simulated Slot 1 save chips, for host-side testing.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+/*
+  Simulated Slot 1 save chips, used as an AuxspiTransport. It models the small
+  512 byte eeprom (type 1), eeprom and FRAM (type 2) and Flash (type 3) with
+  status register, write enable latch, timed write-in-progress, page wrapping,
+  sector erase and JEDEC ID, and optionally the IR bridge of Pokemon HG/SS/B/W.
+  A simulated clock allows timing a workflow without any hardware. */
+
+#ifndef AUXSPI_SIM_H
+#define AUXSPI_SIM_H
+
+#include <nds.h>
+
+#include "auxspi.h"
+
+typedef enum {
+  AUXSPI_SIM_EEPROM_512,  // type 1
+  AUXSPI_SIM_EEPROM,      // type 2
+  AUXSPI_SIM_FRAM,        // type 2, no write delay and no pages
+  AUXSPI_SIM_FLASH        // type 3
+} auxspi_sim_chip;
+
+// All latencies are in nanoseconds.
+struct AuxspiSimTiming {
+  u32 byte;              // one byte at 4 MHz (four times that at 1 MHz)
+  u32 eeprom_write;      // writing one eeprom page
+  u32 flash_program;     // programming one Flash page
+  u32 flash_erase;       // erasing one 64 kB Flash sector
+  u32 flash_erase_4k;    // erasing one 4 kB Flash subsector
+  u32 delay;             // one unit of swiDelay
+  u32 ir_switch;         // IR bridge switching to pass-through mode
+};
+
+struct AuxspiSimStats {
+  u32 transactions;
+  u32 bytes;
+  u32 programs;
+  u32 erases;
+  u32 erases_4k;
+  u32 ir_switches;  // transactions passed through the IR bridge
+  u64 elapsed;      // simulated wall time in nanoseconds
+};
+
+extern const AuxspiSimTiming auxspi_sim_default_timing;
+extern const AuxspiTransport auxspi_sim_transport;
+
+// Creates a simulated save chip of "size" bytes and makes it the active
+//  transport. "jedec" is the ID of a Flash chip; 0 selects an ST chip of the
+//  given size. Chips by Macronix (0xc2xxxx) support 4 kB erases. With
+//  "infrared", the chip sits behind an IR bridge.
+bool auxspi_sim_init(auxspi_sim_chip chip, u32 size, u32 jedec = 0,
+                     bool infrared = false,
+                     const AuxspiSimTiming* timing = NULL);
+// Frees the simulated chip and returns to the real Slot 1 bus.
+void auxspi_sim_shutdown();
+
+// Direct access to the simulated memory, e.g. to preload a save.
+u8* auxspi_sim_memory();
+
+const AuxspiSimStats* auxspi_sim_get_stats();
+void auxspi_sim_reset_stats();
+// Prints the statistics gathered since the last reset, then resets them. Call
+//  this after each workflow you want to time.
+void auxspi_sim_report(const char* workflow);
+
+#endif  // AUXSPI_SIM_H
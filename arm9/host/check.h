@@ -0,0 +1,52 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * check.h: a minimal harness for the host-side tests
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+/*
+  Each test program calls CHECK() as often as it likes and ends main() with
+  "return checkDone();", which prints a summary and fails the test if any
+  check failed. */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int check_count = 0;
+static int check_failed = 0;
+
+#define CHECK(cond)                                                 \
+  do {                                                              \
+    check_count++;                                                  \
+    if (!(cond)) {                                                  \
+      check_failed++;                                               \
+      printf("%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    }                                                               \
+  } while (0)
+
+static inline int checkDone() {
+  printf("%i checks, %i failed\n", check_count, check_failed);
+  return check_failed ? 1 : 0;
+}
+
+#endif  // CHECK_H
@@ -0,0 +1,717 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * dsCard_sim.cpp: A simulated EZFlash 3-in-1 with a simple timing model.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "dsCard_sim.h"
+
+#include <nds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rough numbers taken from common datasheets (Spansion S29GL, Intel P30) and
+//  the Slot 2 bus with the wait states used for the 3in1.
+const NorSimTiming norSimDefaultTiming = {
+    200,        // read
+    200,        // write
+    60000,      // program
+    250000,     // buffer
+    500000000,  // erase
+};
+
+#define NOR_SIM_CHIPS 4
+#define NOR_SIM_BUFFER 32  // the biggest write buffer we simulate (in words)
+#define NOR_SIM_PSRAM 0x1000000
+#define NOR_SIM_SRAM 0x10000
+#define NOR_SIM_SRAM_PAGES 16
+#define NOR_SIM_NONE 0xffffffff
+
+enum norSimMode { NOR_SIM_READ, NOR_SIM_ID, NOR_SIM_CFI, NOR_SIM_STATUS };
+
+// where a chip is in a command sequence
+enum norSimCycle {
+  NOR_SIM_IDLE,
+  NOR_SIM_UNLOCK1,
+  NOR_SIM_UNLOCK2,
+  NOR_SIM_ERASE1,
+  NOR_SIM_ERASE2,
+  NOR_SIM_ERASE3,
+  NOR_SIM_ERASE_CONFIRM,
+  NOR_SIM_LOCK,
+  NOR_SIM_PROGRAM,
+  NOR_SIM_BUF_COUNT,
+  NOR_SIM_BUF_DATA,
+  NOR_SIM_BUF_CONFIRM,
+  NOR_SIM_BYPASS_EXIT
+};
+
+struct NorSimChip {
+  norSimMode mode;
+  norSimCycle cycle;
+  bool bypass;
+  bool abort;  // AMD: a write buffer was aborted, until the next reset
+  bool failed;  // AMD: a program needed a 0 turned to 1, until the next reset
+  bool erasing;
+  bool toggle;  // AMD: DQ6 toggles on every read while busy
+  u8 status;    // Intel: error bits of the status register
+  u16 last;     // AMD: the last word programmed, for DQ7 polling
+  // the write buffer being loaded
+  u32 buf_count;
+  u32 buf_left;
+  u32 buf_word[NOR_SIM_BUFFER];
+  u16 buf_data[NOR_SIM_BUFFER];
+  u64 busy_until;
+};
+
+static struct {
+  u32 id;
+  bool intel;
+  u32 size;       // of the NOR
+  u32 pair_size;  // the part of the NOR made by one pair of chips
+  u32 chip_words;
+  u32 buffer_words;
+  bool bypass_ok;
+  bool fail;  // every program fails (see norSimFailPrograms)
+  u8 *nor;
+  u8 *psram;
+  u8 *sram;
+  NorSimChip chip[NOR_SIM_CHIPS];
+  // control registers
+  u32 unlock;  // how far the register sequence went
+  u16 rompage;
+  u16 rampage;
+  bool write_enable;
+  NorSimTiming timing;
+  NorSimStats stats;
+} sim;
+
+// ---------------------------------------------------------
+//  local functions
+bool norSimBusy(const NorSimChip *c) {
+  return sim.stats.elapsed < c->busy_until;
+}
+
+// Both chips of a pair are interleaved in blocks of 8 kB.
+u32 norSimOffset(u32 n, u32 w) {
+  return (n >> 1) * sim.pair_size + ((w >> 12) << 14) + ((n & 1) << 13) +
+         ((w & 0xfff) << 1);
+}
+
+u32 norSimChipAt(u32 ofs) {
+  return ((ofs / sim.pair_size) << 1) | ((ofs >> 13) & 1);
+}
+
+u32 norSimWordAt(u32 ofs) {
+  ofs %= sim.pair_size;
+  return ((ofs >> 14) << 12) | ((ofs >> 1) & 0xfff);
+}
+
+u16 *norSimWord(u32 n, u32 w) { return (u16 *)(sim.nor + norSimOffset(n, w)); }
+
+// the offset in the NOR of an address in the ROM window, or NOR_SIM_NONE
+u32 norSimMap(u32 addr) {
+  u32 ofs = addr - FlashBase;
+  if (sim.rompage == 768)
+    ofs += 0x2000000;
+  else if (sim.rompage != 0)
+    return NOR_SIM_NONE;
+  return (ofs < sim.size) ? ofs : NOR_SIM_NONE;
+}
+
+u32 norSimLog2(u32 n) {
+  u32 i = 0;
+  while ((1u << i) < n) i++;
+  return i;
+}
+
+// Each chip starts with a few small parameter blocks.
+void norSimErase(u32 n, u32 w) {
+  u32 big = sim.intel ? 0x10000 : 0x8000;
+  u32 len = (w < big) ? (sim.intel ? 0x4000 : 0x1000) : big;
+  u32 first = w & ~(len - 1);
+  for (u32 i = first; i < first + len; i += 0x1000)
+    memset(sim.nor + norSimOffset(n, i), 0xff, 0x2000);
+  sim.stats.erases++;
+}
+
+u16 norSimCfi(u32 w) {
+  switch (w & 0xff) {
+    case 0x10:
+      return 'Q';
+    case 0x11:
+      return 'R';
+    case 0x12:
+      return 'Y';
+    case 0x27:  // 2^n bytes per chip
+      return norSimLog2(sim.chip_words * 2);
+    case 0x2a:  // 2^n bytes per write buffer
+      return sim.buffer_words ? norSimLog2(sim.buffer_words * 2) : 0;
+  }
+  return 0;
+}
+
+// Collects a word for the write buffer; returns false if it does not fit.
+bool norSimBufferWord(NorSimChip *c, u32 w, u16 v) {
+  u32 page = w / sim.buffer_words;
+  if (c->buf_count && (page != c->buf_word[0] / sim.buffer_words))
+    return false;
+  c->buf_word[c->buf_count] = w;
+  c->buf_data[c->buf_count++] = v;
+  c->buf_left--;
+  return true;
+}
+
+void norSimBufferProgram(u32 n) {
+  NorSimChip *c = &sim.chip[n];
+  for (u32 i = 0; i < c->buf_count; i++) {
+    u16 *word = norSimWord(n, c->buf_word[i]);
+    if ((*word & c->buf_data[i]) != c->buf_data[i]) c->failed = true;
+    *word &= c->buf_data[i];
+  }
+  c->last = c->buf_data[c->buf_count - 1];
+  c->erasing = false;
+  c->busy_until = sim.stats.elapsed + sim.timing.buffer;
+  sim.stats.buffers++;
+}
+
+void norSimProgram(u32 n, u32 w, u16 v, u32 time) {
+  NorSimChip *c = &sim.chip[n];
+  u16 *word = norSimWord(n, w);
+  if ((*word & v) != v) c->failed = true;
+  *word &= v;
+  c->last = v;
+  c->erasing = false;
+  c->busy_until = sim.stats.elapsed + time;
+  sim.stats.programs++;
+}
+
+// ---------------------------------------------------------
+// AMD command set: the unlock cycles are decoded with the lower 11 address
+//  bits, so the same commands work at 0x555 and 0x1555.
+void norSimAmdAbort(NorSimChip *c, u16 v) {
+  c->abort = true;
+  c->last = v;
+  c->cycle = NOR_SIM_IDLE;
+  sim.stats.aborts++;
+}
+
+void norSimAmdWrite(u32 n, u32 w, u16 v) {
+  NorSimChip *c = &sim.chip[n];
+  if (norSimBusy(c)) return;
+  if (c->failed) {
+    if (v == 0xf0) {
+      c->failed = false;
+      c->mode = NOR_SIM_READ;
+      c->cycle = NOR_SIM_IDLE;
+    }
+    return;
+  }
+  u32 cmd = w & 0x7ff;
+
+  switch (c->cycle) {
+    case NOR_SIM_PROGRAM:
+      c->cycle = NOR_SIM_IDLE;
+      if (sim.fail)
+        norSimAmdAbort(c, v);
+      else
+        norSimProgram(n, w, v, sim.timing.program);
+      return;
+    case NOR_SIM_BUF_COUNT:
+      c->buf_count = 0;
+      c->buf_left = v + 1;
+      if (c->buf_left > sim.buffer_words)
+        norSimAmdAbort(c, v);
+      else
+        c->cycle = NOR_SIM_BUF_DATA;
+      return;
+    case NOR_SIM_BUF_DATA:
+      if (!norSimBufferWord(c, w, v))
+        norSimAmdAbort(c, v);
+      else if (!c->buf_left)
+        c->cycle = NOR_SIM_BUF_CONFIRM;
+      return;
+    case NOR_SIM_BUF_CONFIRM:
+      c->cycle = NOR_SIM_IDLE;
+      if ((v == 0x29) && !sim.fail)
+        norSimBufferProgram(n);
+      else
+        norSimAmdAbort(c, c->buf_data[c->buf_count - 1]);
+      return;
+    case NOR_SIM_BYPASS_EXIT:
+      c->cycle = NOR_SIM_IDLE;
+      if (v == 0x00) c->bypass = false;
+      return;
+    default:
+      break;
+  }
+
+  // unlock bypass: no unlock cycles, and only a few commands
+  if (c->bypass) {
+    if (v == 0xa0)
+      c->cycle = NOR_SIM_PROGRAM;
+    else if (v == 0x90)
+      c->cycle = NOR_SIM_BYPASS_EXIT;
+    else if ((v == 0x25) && sim.buffer_words)
+      c->cycle = NOR_SIM_BUF_COUNT;
+    return;
+  }
+  // a reset is accepted at any time, except after an aborted write buffer
+  if ((v == 0xf0) && !c->abort) {
+    c->mode = NOR_SIM_READ;
+    c->cycle = NOR_SIM_IDLE;
+    return;
+  }
+
+  switch (c->cycle) {
+    case NOR_SIM_IDLE:
+      if ((cmd == 0x555) && (v == 0xaa))
+        c->cycle = NOR_SIM_UNLOCK1;
+      else if ((cmd == 0x55) && (v == 0x98) && !c->abort)
+        c->mode = NOR_SIM_CFI;
+      break;
+    case NOR_SIM_UNLOCK1:
+      c->cycle =
+          ((cmd == 0x2aa) && (v == 0x55)) ? NOR_SIM_UNLOCK2 : NOR_SIM_IDLE;
+      break;
+    case NOR_SIM_UNLOCK2:
+      c->cycle = NOR_SIM_IDLE;
+      if (c->abort) {
+        // the "write to buffer abort reset"
+        if (v == 0xf0) {
+          c->abort = false;
+          c->mode = NOR_SIM_READ;
+        }
+        break;
+      }
+      // the write buffer is loaded at the address of the data
+      if (v == 0x25) {
+        if (sim.buffer_words) c->cycle = NOR_SIM_BUF_COUNT;
+        break;
+      }
+      if (cmd != 0x555) break;
+      switch (v) {
+        case 0x90:
+          c->mode = NOR_SIM_ID;
+          break;
+        case 0xa0:
+          c->cycle = NOR_SIM_PROGRAM;
+          break;
+        case 0x80:
+          c->cycle = NOR_SIM_ERASE1;
+          break;
+        case 0x20:
+          c->bypass = sim.bypass_ok;
+          break;
+      }
+      break;
+    case NOR_SIM_ERASE1:
+      c->cycle =
+          ((cmd == 0x555) && (v == 0xaa)) ? NOR_SIM_ERASE2 : NOR_SIM_IDLE;
+      break;
+    case NOR_SIM_ERASE2:
+      c->cycle =
+          ((cmd == 0x2aa) && (v == 0x55)) ? NOR_SIM_ERASE3 : NOR_SIM_IDLE;
+      break;
+    case NOR_SIM_ERASE3:
+      c->cycle = NOR_SIM_IDLE;
+      if (v == 0x30) {
+        norSimErase(n, w);
+      } else if ((v == 0x10) && (cmd == 0x555)) {
+        for (u32 i = 0; i < sim.chip_words; i += 0x1000)
+          memset(sim.nor + norSimOffset(n, i), 0xff, 0x2000);
+        sim.stats.erases++;
+      } else {
+        break;
+      }
+      c->erasing = true;
+      c->busy_until = sim.stats.elapsed + sim.timing.erase;
+      break;
+    default:
+      break;
+  }
+}
+
+u16 norSimAmdRead(u32 n, u32 w) {
+  NorSimChip *c = &sim.chip[n];
+  if (norSimBusy(c) || c->abort || c->failed) {
+    c->toggle = !c->toggle;
+    u16 status = c->toggle ? 0x40 : 0x00;
+    // DQ7 reads inverted while programming, and 0 while erasing
+    if (!c->erasing) status |= ~c->last & 0x80;
+    if (c->abort) status |= 0x02;
+    // DQ5: the program ran out of time
+    if (c->failed && !norSimBusy(c)) status |= 0x20;
+    return status;
+  }
+  switch (c->mode) {
+    case NOR_SIM_ID:
+      switch (w & 0xff) {
+        case 0x00:
+          return 0x0001;
+        case 0x01:
+          return sim.id >> 16;
+        case 0x0e:
+          return sim.id & 0xffff;
+        case 0x0f:
+          return 0x2201;
+      }
+      return 0;
+    case NOR_SIM_CFI:
+      return norSimCfi(w);
+    default:
+      return *norSimWord(n, w);
+  }
+}
+
+// ---------------------------------------------------------
+// Intel command set: after a program or erase command, the chip returns its
+//  status register until it is put back in read mode. Errors set SR.4, which
+//  is what WriteNorFlashINTEL looks for.
+void norSimIntelError(NorSimChip *c) {
+  c->status |= 0x10;
+  c->cycle = NOR_SIM_IDLE;
+  sim.stats.aborts++;
+}
+
+void norSimIntelWrite(u32 n, u32 w, u16 v) {
+  NorSimChip *c = &sim.chip[n];
+  if (norSimBusy(c)) return;
+
+  switch (c->cycle) {
+    case NOR_SIM_PROGRAM:
+      c->cycle = NOR_SIM_IDLE;
+      if (sim.fail)
+        norSimIntelError(c);
+      else
+        norSimProgram(n, w, v, sim.timing.program);
+      return;
+    case NOR_SIM_BUF_COUNT:
+      // like the chips of the 3in1, the status may be asked for before the
+      //  word count
+      if (v == 0x70) return;
+      c->buf_count = 0;
+      c->buf_left = v + 1;
+      if (c->buf_left > sim.buffer_words)
+        norSimIntelError(c);
+      else
+        c->cycle = NOR_SIM_BUF_DATA;
+      return;
+    case NOR_SIM_BUF_DATA:
+      if (!norSimBufferWord(c, w, v))
+        norSimIntelError(c);
+      else if (!c->buf_left)
+        c->cycle = NOR_SIM_BUF_CONFIRM;
+      return;
+    case NOR_SIM_BUF_CONFIRM:
+      c->cycle = NOR_SIM_IDLE;
+      if ((v == 0xd0) && !sim.fail)
+        norSimBufferProgram(n);
+      else
+        norSimIntelError(c);
+      return;
+    case NOR_SIM_ERASE_CONFIRM:
+      c->cycle = NOR_SIM_IDLE;
+      if (v != 0xd0) {
+        norSimIntelError(c);
+        return;
+      }
+      norSimErase(n, w);
+      c->erasing = true;
+      c->busy_until = sim.stats.elapsed + sim.timing.erase;
+      return;
+    case NOR_SIM_LOCK:
+      // blocks are not locked by the simulation
+      c->cycle = NOR_SIM_IDLE;
+      return;
+    default:
+      break;
+  }
+
+  switch (v & 0xff) {
+    case 0xff:
+      c->mode = NOR_SIM_READ;
+      break;
+    case 0x90:
+      c->mode = NOR_SIM_ID;
+      break;
+    case 0x98:
+      c->mode = NOR_SIM_CFI;
+      break;
+    case 0x70:
+      c->mode = NOR_SIM_STATUS;
+      break;
+    case 0x50:
+      c->status = 0;
+      break;
+    case 0xe8:
+      c->mode = NOR_SIM_STATUS;
+      if (sim.buffer_words) c->cycle = NOR_SIM_BUF_COUNT;
+      break;
+    case 0x40:
+    case 0x10:
+      c->mode = NOR_SIM_STATUS;
+      c->cycle = NOR_SIM_PROGRAM;
+      break;
+    case 0x20:
+      c->mode = NOR_SIM_STATUS;
+      c->cycle = NOR_SIM_ERASE_CONFIRM;
+      break;
+    case 0x60:
+      c->mode = NOR_SIM_STATUS;
+      c->cycle = NOR_SIM_LOCK;
+      break;
+  }
+}
+
+u16 norSimIntelRead(u32 n, u32 w) {
+  NorSimChip *c = &sim.chip[n];
+  if (norSimBusy(c)) return 0x00;
+  switch (c->mode) {
+    case NOR_SIM_STATUS:
+      return 0x80 | c->status;
+    case NOR_SIM_ID:
+      switch (w & 0xff) {
+        case 0x00:
+          return 0x0089;
+        case 0x01:
+          return 0x8816;
+      }
+      return 0;
+    case NOR_SIM_CFI:
+      return norSimCfi(w);
+    default:
+      return *norSimWord(n, w);
+  }
+}
+
+// ---------------------------------------------------------
+// The control registers are written in a fixed sequence; returns true if the
+//  write was part of it (and so does not reach the memories).
+bool norSimRegister(u32 addr, u16 v) {
+  static const u32 seq_addr[4] = {0x9fe0000, 0x8000000, 0x8020000, 0x8040000};
+  static const u16 seq_val[4] = {0xd200, 0x1500, 0xd200, 0x1500};
+  if (sim.unlock == 4) {
+    switch (addr) {
+      case 0x9880000:
+        sim.rompage = v;
+        break;
+      case 0x9c00000:
+        sim.rampage = v;
+        break;
+      case 0x9c40000:
+        sim.write_enable = (v == 0x1500) || (v == 0xa500);
+        break;
+      default:  // serial mode and rumble: nothing to simulate
+        break;
+    }
+    sim.unlock = 5;
+    return true;
+  }
+  if (sim.unlock == 5) {
+    sim.unlock = 0;
+    if ((addr == 0x9fc0000) && (v == 0x1500)) return true;
+  }
+  if ((addr == seq_addr[sim.unlock]) && (v == seq_val[sim.unlock])) {
+    sim.unlock++;
+    return true;
+  }
+  sim.unlock = 0;
+  if ((addr == seq_addr[0]) && (v == seq_val[0])) {
+    sim.unlock = 1;
+    return true;
+  }
+  return false;
+}
+
+u8 *norSimSram(u32 addr) {
+  return sim.sram + (sim.rampage % NOR_SIM_SRAM_PAGES) * NOR_SIM_SRAM +
+         (addr & (NOR_SIM_SRAM - 1));
+}
+
+// ---------------------------------------------------------
+//  bus functions
+u16 norSimRead16(u32 addr) {
+  sim.stats.reads++;
+  sim.stats.elapsed += sim.timing.read;
+  if (!sim.nor) return 0xffff;
+
+  if (addr >= 0x0a000000) return *norSimSram(addr) * 0x0101;
+  if (sim.rompage == 192) {
+    u32 ofs = (addr - FlashBase) & ~1;
+    return (ofs < NOR_SIM_PSRAM) ? *(u16 *)(sim.psram + ofs) : 0xffff;
+  }
+  u32 ofs = norSimMap(addr);
+  if (ofs == NOR_SIM_NONE) return 0xffff;
+  u32 n = norSimChipAt(ofs);
+  u32 w = norSimWordAt(ofs);
+  return sim.intel ? norSimIntelRead(n, w) : norSimAmdRead(n, w);
+}
+
+void norSimWrite16(u32 addr, u16 v) {
+  sim.stats.writes++;
+  sim.stats.elapsed += sim.timing.write;
+  if (!sim.nor || norSimRegister(addr, v)) return;
+
+  if (addr >= 0x0a000000) {
+    *norSimSram(addr) = v & 0xff;
+    return;
+  }
+  if (!sim.write_enable) return;
+  if (sim.rompage == 192) {
+    u32 ofs = (addr - FlashBase) & ~1;
+    if (ofs < NOR_SIM_PSRAM) *(u16 *)(sim.psram + ofs) = v;
+    return;
+  }
+  u32 ofs = norSimMap(addr);
+  if (ofs == NOR_SIM_NONE) return;
+  u32 n = norSimChipAt(ofs);
+  u32 w = norSimWordAt(ofs);
+  if (sim.intel)
+    norSimIntelWrite(n, w, v);
+  else
+    norSimAmdWrite(n, w, v);
+}
+
+u8 norSimRead8(u32 addr) {
+  sim.stats.reads++;
+  sim.stats.elapsed += sim.timing.read;
+  if (!sim.nor || (addr < 0x0a000000)) return 0xff;
+  return *norSimSram(addr);
+}
+
+void norSimWrite8(u32 addr, u8 v) {
+  sim.stats.writes++;
+  sim.stats.elapsed += sim.timing.write;
+  if (!sim.nor || (addr < 0x0a000000)) return;
+  *norSimSram(addr) = v;
+}
+
+const u8 *norSimWindow(u32 addr, u32 len) {
+  sim.stats.reads += len / 2;
+  sim.stats.elapsed += (u64)(len / 2) * sim.timing.read;
+  if (!sim.nor) return NULL;
+
+  u32 ofs = addr - FlashBase;
+  if (sim.rompage == 192) {
+    if (ofs + len <= NOR_SIM_PSRAM) return sim.psram + ofs;
+    sim.stats.bad_reads++;
+    return sim.psram;
+  }
+  ofs = norSimMap(addr);
+  if ((ofs == NOR_SIM_NONE) || (ofs + len > sim.size)) {
+    sim.stats.bad_reads++;
+    return sim.nor;
+  }
+  // both chips of the pair have to be in read mode
+  u32 first = norSimChipAt(ofs) & ~1;
+  for (u32 n = first; n < first + 2; n++) {
+    const NorSimChip *c = &sim.chip[n];
+    if (norSimBusy(c) || c->abort || (c->mode != NOR_SIM_READ) ||
+        c->bypass) {
+      sim.stats.bad_reads++;
+      break;
+    }
+  }
+  return sim.nor + ofs;
+}
+
+const NorBus norSimBus = {norSimRead16, norSimWrite16, norSimRead8,
+                          norSimWrite8, norSimWindow};
+
+// ---------------------------------------------------------
+bool norSimInit(u32 id, u32 buffer_words, bool bypass,
+                const NorSimTiming *timing) {
+  norSimShutdown();
+  sim.intel = (id == 0x89168916);
+  if (!sim.intel && (id != 0x227E2218) && (id != 0x227E2202)) return false;
+  // the write buffer has to be a power of two
+  if (buffer_words > NOR_SIM_BUFFER) return false;
+  if (buffer_words & (buffer_words - 1)) return false;
+
+  sim.id = id;
+  sim.size = sim.intel ? 0x4000000 : 0x2000000;
+  sim.pair_size = (id == 0x227E2202) ? 0x1000000 : sim.size;
+  sim.chip_words = sim.pair_size / 4;
+  sim.buffer_words = buffer_words;
+  sim.bypass_ok = bypass;
+  sim.fail = false;
+  sim.nor = (u8 *)malloc(sim.size);
+  sim.psram = (u8 *)malloc(NOR_SIM_PSRAM);
+  sim.sram = (u8 *)malloc(NOR_SIM_SRAM * NOR_SIM_SRAM_PAGES);
+  if (!sim.nor || !sim.psram || !sim.sram) {
+    norSimShutdown();
+    return false;
+  }
+  memset(sim.nor, 0xff, sim.size);
+  memset(sim.psram, 0, NOR_SIM_PSRAM);
+  memset(sim.sram, 0xff, NOR_SIM_SRAM * NOR_SIM_SRAM_PAGES);
+
+  memset(sim.chip, 0, sizeof(sim.chip));
+  sim.unlock = 0;
+  sim.rompage = 0;
+  sim.rampage = 0;
+  sim.write_enable = false;
+  sim.timing = timing ? *timing : norSimDefaultTiming;
+  norSimResetStats();
+
+  SetNorBus(&norSimBus);
+  return true;
+}
+
+void norSimShutdown() {
+  if (GetNorBus() == &norSimBus) SetNorBus(NULL);
+  free(sim.nor);
+  free(sim.psram);
+  free(sim.sram);
+  sim.nor = NULL;
+  sim.psram = NULL;
+  sim.sram = NULL;
+}
+
+u8 *norSimMemory() { return sim.nor; }
+
+u8 *norSimPsram() { return sim.psram; }
+
+void norSimFailPrograms(bool fail) { sim.fail = fail; }
+
+const NorSimStats *norSimGetStats() { return &sim.stats; }
+
+void norSimResetStats() {
+  // the clock starts again, but chips that are busy stay busy
+  for (u32 n = 0; n < NOR_SIM_CHIPS; n++) {
+    NorSimChip *c = &sim.chip[n];
+    c->busy_until = norSimBusy(c) ? c->busy_until - sim.stats.elapsed : 0;
+  }
+  memset(&sim.stats, 0, sizeof(sim.stats));
+}
+
+void norSimReport(const char *workflow) {
+  iprintf("%s: %lu us\n", workflow, (unsigned long)(sim.stats.elapsed / 1000));
+  iprintf(" r:%lu w:%lu p:%lu/%lu e:%lu a:%lu x:%lu\n",
+          (unsigned long)sim.stats.reads, (unsigned long)sim.stats.writes,
+          (unsigned long)sim.stats.programs, (unsigned long)sim.stats.buffers,
+          (unsigned long)sim.stats.erases, (unsigned long)sim.stats.aborts,
+          (unsigned long)sim.stats.bad_reads);
+  norSimResetStats();
+}
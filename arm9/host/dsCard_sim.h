@@ -0,0 +1,88 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * dsCard_sim.h: header file for dsCard_sim.cpp
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+/*
+  A simulated EZFlash 3in1, used as a NorBus. It models the control registers
+  (ROM/RAM page, NOR write enable), the two interleaved NOR chips with the
+  AMD (0x227E) or Intel (0x8916) command set (ID and CFI mode, block erase,
+  status polling, word and write buffer programming, unlock bypass), the PSRAM
+  and the SRAM, and keeps a simulated clock so the time spent by a workflow can
+  be measured without any hardware. */
+
+#ifndef DSCARD_SIM_H
+#define DSCARD_SIM_H
+
+#include <nds.h>
+
+#include "dsCard.h"
+
+// All latencies are in nanoseconds.
+struct NorSimTiming {
+  u32 read;     // one 16 bit read (NOR, PSRAM or a status poll)
+  u32 write;    // one 16 bit write (data or command)
+  u32 program;  // programming one NOR word
+  u32 buffer;   // programming one write buffer
+  u32 erase;    // erasing one NOR block
+};
+
+struct NorSimStats {
+  u32 reads;
+  u32 writes;
+  u32 programs;  // single words
+  u32 buffers;   // write buffers
+  u32 erases;
+  u32 aborts;     // write buffer aborts and Intel sequence errors
+  u32 bad_reads;  // direct reads while a chip was not in read mode
+  u64 elapsed;    // simulated wall time in nanoseconds
+};
+
+extern const NorSimTiming norSimDefaultTiming;
+extern const NorBus norSimBus;
+
+// Creates a simulated 3in1 and makes it the active bus. "id" is what
+//  ReadNorFlashID finds: 0x89168916 (Intel, 64 MB), 0x227E2218 (AMD, 32 MB) or
+//  0x227E2202 (AMD, 32 MB in two pairs of chips). "buffer_words" is the size of
+//  the write buffer of each chip (0 for none); "bypass" is false for AMD chips
+//  without unlock bypass.
+bool norSimInit(u32 id, u32 buffer_words = 16, bool bypass = true,
+                const NorSimTiming *timing = NULL);
+// Frees the simulated 3in1 and returns to the real Slot 2 bus.
+void norSimShutdown();
+
+// Direct access to the simulated memories, e.g. to preload a staged save. The
+//  NOR is seen the way it is mapped, with both chips interleaved.
+u8 *norSimMemory();
+u8 *norSimPsram();
+
+// Makes every program command fail (or work again), like a worn out chip: the
+//  AMD chips abort (DQ1) until they are reset, the Intel chips set SR.4.
+void norSimFailPrograms(bool fail);
+
+const NorSimStats *norSimGetStats();
+void norSimResetStats();
+// Prints the statistics gathered since the last reset, then resets them. Call
+//  this after each workflow you want to time.
+void norSimReport(const char *workflow);
+
+#endif  // DSCARD_SIM_H
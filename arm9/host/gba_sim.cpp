@@ -0,0 +1,246 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * gba_sim.cpp: A simulated GBA save chip with a simple timing model.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "gba_sim.h"
+
+#include <nds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rough numbers taken from common datasheets (Macronix/SST Flash, 8 MHz bus).
+const GbaSimTiming gbaSimDefaultTiming = {
+    250,        // read
+    250,        // write
+    20000,      // flash_program
+    25000000,   // flash_erase_sector
+    100000000,  // flash_erase_chip
+    60000,      // eeprom_block
+    125,        // delay
+};
+
+enum simFlashState { SIM_IDLE, SIM_UNLOCK1, SIM_UNLOCK2 };
+
+static struct {
+  u8 type;
+  u32 size;
+  u8 *mem;
+  u16 id;
+  GbaSimTiming timing;
+  GbaSimStats stats;
+  // Flash command state machine
+  simFlashState state;
+  bool id_mode;
+  bool erase_armed;
+  bool bank_armed;
+  u32 program_left;  // number of bytes the last "program" command allows
+  u8 bank;
+} sim;
+
+// ---------------------------------------------------------
+//  local functions
+bool simIsFlash() { return (sim.type == 4) || (sim.type == 5); }
+
+bool simIsAtmel() { return sim.id == 0x3d1f; }
+
+u32 simFlashAddr(u32 ofs) {
+  return ((sim.bank << 16) | (ofs & 0xffff)) % sim.size;
+}
+
+void simFlashCommand(u32 ofs, u8 val) {
+  // a reset command is accepted at any time, except for data being programmed
+  if ((val == 0xf0) && !sim.program_left) {
+    sim.state = SIM_IDLE;
+    sim.id_mode = false;
+    sim.erase_armed = false;
+    return;
+  }
+
+  switch (sim.state) {
+    case SIM_IDLE:
+      if (sim.program_left) {
+        u32 addr = simFlashAddr(ofs);
+        if (simIsAtmel()) {
+          // Atmel chips erase each page internally, so bytes are replaced
+          sim.mem[addr] = val;
+          if (--sim.program_left == 0) {
+            sim.stats.programs++;
+            sim.stats.elapsed += sim.timing.flash_program;
+          }
+        } else {
+          // programming can only clear bits
+          sim.mem[addr] &= val;
+          sim.program_left--;
+          sim.stats.programs++;
+          sim.stats.elapsed += sim.timing.flash_program;
+        }
+      } else if (sim.bank_armed && (ofs == 0)) {
+        sim.bank = (sim.type == 5) ? (val & 1) : 0;
+        sim.bank_armed = false;
+        sim.stats.bank_switches++;
+      } else if ((ofs == 0x5555) && (val == 0xaa)) {
+        sim.state = SIM_UNLOCK1;
+      }
+      break;
+    case SIM_UNLOCK1:
+      sim.state = ((ofs == 0x2aaa) && (val == 0x55)) ? SIM_UNLOCK2 : SIM_IDLE;
+      break;
+    case SIM_UNLOCK2:
+      sim.state = SIM_IDLE;
+      if (sim.erase_armed && (val == 0x30)) {
+        // sector erase, at the address of the sector
+        u32 addr = simFlashAddr(ofs) & ~0xfff;
+        memset(&sim.mem[addr], 0xff, 0x1000);
+        sim.erase_armed = false;
+        sim.stats.sector_erases++;
+        sim.stats.elapsed += sim.timing.flash_erase_sector;
+        break;
+      }
+      if (ofs != 0x5555) break;
+      switch (val) {
+        case 0x90:  // enter ID mode
+          sim.id_mode = true;
+          break;
+        case 0x80:  // erase setup
+          sim.erase_armed = true;
+          break;
+        case 0x10:  // erase entire chip
+          if (sim.erase_armed) {
+            memset(sim.mem, 0xff, sim.size);
+            sim.erase_armed = false;
+            sim.stats.chip_erases++;
+            sim.stats.elapsed += sim.timing.flash_erase_chip;
+          }
+          break;
+        case 0xa0:  // program byte (or page on Atmel chips)
+          sim.program_left = simIsAtmel() ? 128 : 1;
+          break;
+        case 0xb0:  // bank switch, next write to offset 0 selects the bank
+          sim.bank_armed = true;
+          break;
+      }
+      break;
+  }
+}
+
+// ---------------------------------------------------------
+//  backend functions
+u8 gbaSimRead8(u32 ofs) {
+  sim.stats.reads++;
+  sim.stats.elapsed += sim.timing.read;
+  if (!sim.mem) return 0xff;
+
+  if (sim.type == 3) return sim.mem[ofs % sim.size];
+  if (simIsFlash()) {
+    if (sim.id_mode && (ofs < 2))
+      return (ofs == 0) ? (sim.id >> 8) : (sim.id & 0xff);
+    return sim.mem[simFlashAddr(ofs)];
+  }
+  return 0xff;
+}
+
+void gbaSimWrite8(u32 ofs, u8 val) {
+  sim.stats.writes++;
+  sim.stats.elapsed += sim.timing.write;
+  if (!sim.mem) return;
+
+  if (sim.type == 3)
+    sim.mem[ofs % sim.size] = val;
+  else if (simIsFlash())
+    simFlashCommand(ofs, val);
+}
+
+void gbaSimDelay(u32 count) {
+  sim.stats.elapsed += (u64)count * sim.timing.delay;
+}
+
+void gbaSimEepromRead8(u8 *out, u32 block, bool short_addr) {
+  sim.stats.eeprom_blocks++;
+  sim.stats.elapsed += sim.timing.eeprom_block;
+  if (!sim.mem || (sim.type > 2) || ((block << 3) >= sim.size)) {
+    memset(out, 0xff, 8);
+    return;
+  }
+  memcpy(out, &sim.mem[block << 3], 8);
+}
+
+void gbaSimEepromWrite8(const u8 *in, u32 block, bool short_addr) {
+  sim.stats.eeprom_blocks++;
+  sim.stats.elapsed += sim.timing.eeprom_block;
+  if (!sim.mem || (sim.type > 2) || ((block << 3) >= sim.size)) return;
+  memcpy(&sim.mem[block << 3], in, 8);
+}
+
+const GbaSaveBackend gbaSimBackend = {gbaSimRead8, gbaSimWrite8, gbaSimDelay,
+                                      gbaSimEepromRead8, gbaSimEepromWrite8};
+
+// ---------------------------------------------------------
+bool gbaSimInit(u8 type, u16 flash_id, const GbaSimTiming *timing) {
+  gbaSimShutdown();
+  if ((type == 0) || (type > 5)) return false;
+
+  sim.type = type;
+  sim.size = gbaGetSaveSize(type);
+  sim.mem = (u8 *)malloc(sim.size);
+  if (!sim.mem) return false;
+  memset(sim.mem, 0xff, sim.size);
+
+  if (flash_id == 0) flash_id = (type == 5) ? 0xc209 : 0xbfd4;
+  sim.id = flash_id;
+  sim.timing = timing ? *timing : gbaSimDefaultTiming;
+  sim.state = SIM_IDLE;
+  sim.id_mode = false;
+  sim.erase_armed = false;
+  sim.bank_armed = false;
+  sim.program_left = 0;
+  sim.bank = 0;
+  gbaSimResetStats();
+
+  gbaSetBackend(&gbaSimBackend);
+  return true;
+}
+
+void gbaSimShutdown() {
+  if (gbaGetBackend() == &gbaSimBackend) gbaSetBackend(NULL);
+  free(sim.mem);
+  sim.mem = NULL;
+}
+
+u8 *gbaSimMemory() { return sim.mem; }
+
+const GbaSimStats *gbaSimGetStats() { return &sim.stats; }
+
+void gbaSimResetStats() { memset(&sim.stats, 0, sizeof(sim.stats)); }
+
+void gbaSimReport(const char *workflow) {
+  iprintf("%s: %lu us\n", workflow, (unsigned long)(sim.stats.elapsed / 1000));
+  iprintf(" r:%lu w:%lu p:%lu e:%lu/%lu b:%lu\n",
+          (unsigned long)sim.stats.reads, (unsigned long)sim.stats.writes,
+          (unsigned long)sim.stats.programs,
+          (unsigned long)sim.stats.sector_erases,
+          (unsigned long)sim.stats.chip_erases,
+          (unsigned long)sim.stats.bank_switches);
+  gbaSimResetStats();
+}
@@ -0,0 +1,80 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * gba_sim.h: header file for gba_sim.cpp
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+/*
+  A simulated GBA save chip, used as a GbaSaveBackend. It models SRAM, 64k and
+  128k Flash (command sequences, ID mode, sector/chip erase, bank switching,
+  Atmel page writes) and EEPROM, and keeps a simulated clock so the time spent
+  by a workflow can be measured without any hardware. */
+
+#ifndef GBA_SIM_H
+#define GBA_SIM_H
+
+#include <nds.h>
+
+#include "gba.h"
+
+// All latencies are in nanoseconds.
+struct GbaSimTiming {
+  u32 read;                // reading one byte from SRAM/Flash
+  u32 write;               // one bus write (SRAM data or Flash command)
+  u32 flash_program;       // programming one Flash byte (or one Atmel page)
+  u32 flash_erase_sector;  // erasing one 4k Flash sector
+  u32 flash_erase_chip;    // erasing the whole Flash chip
+  u32 eeprom_block;        // reading or writing one 8 byte EEPROM block
+  u32 delay;               // one unit of swiDelay
+};
+
+struct GbaSimStats {
+  u32 reads;
+  u32 writes;
+  u32 programs;
+  u32 sector_erases;
+  u32 chip_erases;
+  u32 bank_switches;
+  u32 eeprom_blocks;
+  u64 elapsed;  // simulated wall time in nanoseconds
+};
+
+extern const GbaSimTiming gbaSimDefaultTiming;
+extern const GbaSaveBackend gbaSimBackend;
+
+// Creates a simulated save chip of the given type (1-5) and makes it the active
+//  backend. "flash_id" is what ID mode returns at offset 0 (high byte) and 1
+//  (low byte); 0 selects a typical chip for the save type. Use 0x3d1f for an
+//  Atmel chip.
+bool gbaSimInit(u8 type, u16 flash_id = 0, const GbaSimTiming *timing = NULL);
+// Frees the simulated chip and returns to the real Slot-2 bus.
+void gbaSimShutdown();
+
+// Direct access to the simulated memory, e.g. to preload a save.
+u8 *gbaSimMemory();
+
+const GbaSimStats *gbaSimGetStats();
+void gbaSimResetStats();
+// Prints the statistics gathered since the last reset, then resets them. Call
+//  this after each workflow you want to time.
+void gbaSimReport(const char *workflow);
+
+#endif  // GBA_SIM_H
@@ -0,0 +1,3 @@
+// host-side tests: there is no network
+#include <nds.h>
+bool Wifi_InitDefault(bool useFirmwareSettings);
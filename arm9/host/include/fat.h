@@ -0,0 +1,3 @@
+// host-side tests: the memory card is never used
+#include <nds.h>
+bool fatInitDefault();
@@ -0,0 +1,128 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * nds.h: the parts of libnds the host-side tests need
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+/*
+  Only types and declarations: the code under test reaches the hardware through
+  the simulators, so none of the registers below may ever be accessed. The
+  functions are implemented in stubs.cpp. */
+
+#ifndef HOST_NDS_H
+#define HOST_NDS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef volatile u8 vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+typedef volatile uint8 vuint8;
+typedef volatile uint16 vuint16;
+typedef volatile uint32 vuint32;
+
+#define BIT(n) (1 << (n))
+#define ITCM_CODE
+#define DTCM_DATA
+#define DTCM_BSS
+#define BUS_CLOCK 33513982
+
+// registers: all of them end up at the same dummy location
+extern vu32 host_register;
+#define REG_EXMEMCNT (*(vu16 *)&host_register)
+#define REG_AUXSPICNT (*(vu16 *)&host_register)
+#define REG_AUXSPIDATA (*(vu8 *)&host_register)
+#define REG_ROMCTRL (*(vu32 *)&host_register)
+#define REG_IME (*(vu32 *)&host_register)
+#define DMA_SRC(n) host_register
+#define DMA_DEST(n) host_register
+#define DMA_CR(n) host_register
+#define DMA_COPY_HALFWORDS 0
+#define DMA_COPY_WORDS 0
+#define DMA_BUSY 0
+#define DMA_32_BIT 0
+#define DMA_16_BIT 0
+#define DMA_ENABLE 0
+#define DMA_START_NOW 0
+#define DMA_SRC_INC 0
+#define DMA_DST_INC 0
+
+void swiDelay(u32 count);
+u32 enterCriticalSection();
+void leaveCriticalSection(u32 state);
+void sysSetBusOwners(bool arm9slot1, bool arm9slot2);
+void DC_FlushRange(const void *base, u32 size);
+void DC_InvalidateRange(const void *base, u32 size);
+void dmaCopyWordsAsynch(u8 channel, const void *src, void *dest, u32 size);
+bool dmaBusy(u8 channel);
+void cpuStartTiming(int timer);
+u32 cpuEndTiming();
+int iprintf(const char *format, ...);
+
+// input: the tests decide which keys are pressed (see stubs.cpp)
+#define KEY_A BIT(0)
+#define KEY_B BIT(1)
+#define KEY_RIGHT BIT(4)
+#define KEY_LEFT BIT(5)
+#define KEY_UP BIT(6)
+#define KEY_DOWN BIT(7)
+#define KEY_R BIT(8)
+#define KEY_L BIT(9)
+#define KEY_X BIT(10)
+#define KEY_Y BIT(11)
+
+void scanKeys();
+u32 keysDown();
+u32 keysCurrent();
+void swiWaitForVBlank();
+bool isDSiMode();
+
+// Slot 1: only the parts of the header that are looked at
+typedef struct sNDSHeader {
+  char gameTitle[12];
+  char gameCode[4];
+  char makercode[2];
+  u8 unitCode;
+} tNDSHeader;
+
+void cardReadHeader(u8 *header);
+
+typedef struct {
+  int dummy;
+} PrintConsole;
+
+#endif  // HOST_NDS_H
@@ -0,0 +1,6 @@
+// host-side tests: there is no DLDI driver
+#include <nds.h>
+typedef struct {
+  char friendlyName[48];
+} DLDI_INTERFACE;
+extern DLDI_INTERFACE *io_dldi_data;
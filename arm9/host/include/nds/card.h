@@ -0,0 +1,2 @@
+// host-side tests: see nds.h
+#include <nds.h>
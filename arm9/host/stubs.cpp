@@ -0,0 +1,93 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * stubs.cpp: libnds and GUI functions for the host-side tests
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <nds.h>
+#include <nds/arm9/dldi.h>
+#include <stdarg.h>
+
+#include "display.h"
+#include "fileselect.h"
+#include "stubs.h"
+
+vu32 host_register;
+u32 host_keys = 0;
+tNDSHeader host_card_header;
+char host_select_dir[256] = ".";
+void (*host_display_hook)(int id) = NULL;
+
+// Backup files are written by the host, with no limit per write.
+static DLDI_INTERFACE host_dldi = {"host"};
+DLDI_INTERFACE *io_dldi_data = &host_dldi;
+
+// The simulators keep their own clocks, so delays and timers do nothing.
+void swiDelay(u32 count) {}
+u32 enterCriticalSection() { return 0; }
+void leaveCriticalSection(u32 state) {}
+void sysSetBusOwners(bool arm9slot1, bool arm9slot2) {}
+void DC_FlushRange(const void *base, u32 size) {}
+void DC_InvalidateRange(const void *base, u32 size) {}
+void cpuStartTiming(int timer) {}
+u32 cpuEndTiming() { return 1; }
+
+// The tests never start a DMA on the host; the window of the simulator is
+//  copied right away.
+void dmaCopyWordsAsynch(u8 channel, const void *src, void *dest, u32 size) {
+  memcpy(dest, src, size);
+}
+bool dmaBusy(u8 channel) { return false; }
+
+void scanKeys() {}
+u32 keysDown() { return host_keys; }
+u32 keysCurrent() { return host_keys; }
+void swiWaitForVBlank() {}
+bool isDSiMode() { return false; }
+void cardReadHeader(u8 *header) {
+  memcpy(header, &host_card_header, sizeof(host_card_header));
+}
+
+void fileSelect(const char *startdir, char *out_dir, char *out_fname,
+                netbuf *buf, bool allow_cancel, bool allow_up) {
+  strcpy(out_dir, host_select_dir);
+  out_fname[0] = 0;
+}
+
+int iprintf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int ret = vprintf(format, args);
+  va_end(args);
+  return ret;
+}
+
+// Messages are not shown; the tests check results, not the GUI.
+static void displayHook(int id) {
+  if (host_display_hook) host_display_hook(id);
+}
+void displayMessageF(int id, ...) { displayHook(id); }
+void displayMessage2F(int id, ...) { displayHook(id); }
+void displayWarning2F(int id, ...) { displayHook(id); }
+void displayStateF(int id, ...) {}
+void displayProgressBar(int cur, int max0) {}
+void displayPrintUpper(bool fc) {}
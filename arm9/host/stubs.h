@@ -0,0 +1,42 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * stubs.h: what the tests control in stubs.cpp
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <nds.h>
+
+// The keys that are held down; every scan reports them as freshly pressed.
+extern u32 host_keys;
+// What cardReadHeader returns, i.e. the game in Slot 1.
+extern tNDSHeader host_card_header;
+// The folder fileSelect picks; no file is ever picked, so a new one is used.
+extern char host_select_dir[256];
+// Called with the string id of every message and warning. The workflows end
+//  in "while (1);" after their last message, so a test that runs one has to
+//  leave it from here (e.g. by longjmp).
+extern void (*host_display_hook)(int id);
+
+#endif  // STUBS_H
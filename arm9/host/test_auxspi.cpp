@@ -0,0 +1,173 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * test_auxspi.cpp: tests of auxspi.cpp against the simulated save chips
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <nds.h>
+
+#include "auxspi.h"
+#include "auxspi_sim.h"
+#include "check.h"
+#include "globals.h"
+
+static u8 save[0x100000], back[0x100000];
+
+// local function
+void fillRandom(u8 *buf, u32 len) {
+  for (u32 i = 0; i < len; i++) buf[i] = rand();
+}
+
+// Records the shortest delay the IR bridge is given.
+static uint32 shortest_delay;
+
+void recordDelay(uint32 count) {
+  if (count < shortest_delay) shortest_delay = count;
+  auxspi_sim_transport.delay(count);
+}
+
+const AuxspiTransport delay_transport = {auxspi_sim_transport.open,
+                                         auxspi_sim_transport.transfer,
+                                         auxspi_sim_transport.close,
+                                         recordDelay};
+
+// Identifies the chip, reads a preloaded save, then writes a new one the way a
+//  restore does and reads it back.
+void testChip(auxspi_sim_chip kind, u32 size, u32 jedec, bool ir,
+              u8 type, const char *name) {
+  CHECK(auxspi_sim_init(kind, size, jedec, ir));
+  size = (kind == AUXSPI_SIM_EEPROM_512) ? 512 : size;
+  fillRandom(auxspi_sim_memory(), size);
+
+  SaveChipInfo chip;
+  auxspi_extra extra = auxspi_has_extra(&chip);
+  CHECK(extra == (ir ? AUXSPI_INFRARED : AUXSPI_DEFAULT));
+  CHECK(chip.type == type);
+  CHECK((1u << chip.size_log2) == size);
+  if (ir) CHECK(chip.ir_delay < (u32)ir_delay);
+
+  auxspi_read_data(0, back, size, &chip);
+  CHECK(!memcmp(back, auxspi_sim_memory(), size));
+
+  fillRandom(save, size);
+  if (type == 3) auxspi_erase(&chip);
+  auxspi_sim_reset_stats();
+  auxspi_write_data(0, save, size, &chip);
+  auxspi_sim_report(name);
+  CHECK(!memcmp(auxspi_sim_memory(), save, size));
+  auxspi_read_data(0, back, size, &chip);
+  CHECK(!memcmp(back, save, size));
+  auxspi_sim_shutdown();
+}
+
+// The IR delay is only calibrated with reads: writes and erases keep the
+//  delay from the ini file.
+void testIrWrites() {
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, 0x80000, 0, true));
+  fillRandom(auxspi_sim_memory(), 0x80000);
+  SaveChipInfo chip;
+  CHECK(auxspi_has_extra(&chip) == AUXSPI_INFRARED);
+  CHECK(chip.ir_delay < (u32)ir_delay);
+
+  auxspi_set_transport(&delay_transport);
+  shortest_delay = ~0u;
+  auxspi_read_data(0, back, 0x1000, &chip);
+  CHECK(shortest_delay == chip.ir_delay);
+  shortest_delay = ~0u;
+  auxspi_erase_sector(0, &chip);
+  CHECK(shortest_delay == (u32)ir_delay);
+  shortest_delay = ~0u;
+  fillRandom(save, 0x10000);
+  auxspi_write_data(0, save, 0x10000, &chip);
+  CHECK(shortest_delay == (u32)ir_delay);
+  CHECK(!memcmp(auxspi_sim_memory(), save, 0x10000));
+  auxspi_set_transport(&auxspi_sim_transport);
+  auxspi_sim_shutdown();
+}
+
+// Erasing a range only erases what is needed, and remembers what is blank.
+void testEraseRange() {
+  SaveChipInfo chip;
+  // ST: 64 kB sectors only
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, 0x80000));
+  fillRandom(auxspi_sim_memory(), 0x80000);
+  memcpy(save, auxspi_sim_memory(), 0x80000);
+  CHECK(auxspi_identify(&chip));
+  CHECK(!chip.subsector);
+  auxspi_sim_reset_stats();
+  auxspi_erase_range(0x11000, 0x1000, &chip);
+  memset(save + 0x10000, 0xff, 0x10000);
+  CHECK(!memcmp(auxspi_sim_memory(), save, 0x80000));
+  CHECK(auxspi_sim_get_stats()->erases == 1);
+  CHECK(auxspi_is_blank(0x10000, 0x10000, &chip));
+  CHECK(!auxspi_is_blank(0x20000, 0x1000, &chip));
+  auxspi_sim_reset_stats();
+  auxspi_erase_range(0x10000, 0x10000, &chip);
+  CHECK(auxspi_sim_get_stats()->erases == 0);
+  auxspi_sim_shutdown();
+
+  // Macronix: 4 kB subsectors
+  JedecChip mx = {0xc22213, 0x13, 256, JEDEC_SUBSECTOR};
+  CHECK(auxspi_add_chip(&mx));
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, 0x80000, 0xc22213));
+  fillRandom(auxspi_sim_memory(), 0x80000);
+  memcpy(save, auxspi_sim_memory(), 0x80000);
+  CHECK(auxspi_identify(&chip));
+  CHECK(chip.subsector);
+  auxspi_sim_reset_stats();
+  auxspi_erase_range(0x11000, 0x1000, &chip);
+  memset(save + 0x11000, 0xff, 0x1000);
+  CHECK(!memcmp(auxspi_sim_memory(), save, 0x80000));
+  CHECK(auxspi_sim_get_stats()->erases_4k == 1);
+  CHECK(auxspi_sim_get_stats()->erases == 0);
+  auxspi_sim_shutdown();
+}
+
+// The chip list is sorted; chips can be added and replaced.
+void testChipList() {
+  SaveChipInfo chip;
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, 0x10000, 0x300010));
+  CHECK(!auxspi_identify(&chip));
+  JedecChip unknown = {0x300010, 0x10, 256, 0};
+  CHECK(auxspi_add_chip(&unknown));
+  CHECK(auxspi_identify(&chip));
+  CHECK(chip.size_log2 == 0x10);
+  CHECK(auxspi_find_chip(0x204013)->size_log2 == 0x13);
+  CHECK(auxspi_find_chip(0x204016) == NULL);
+  auxspi_sim_shutdown();
+  CHECK(auxspi_get_transport() == &auxspi_slot1_transport);
+}
+
+int main() {
+  data = save;
+  size_buf = sizeof(save);
+  testChip(AUXSPI_SIM_EEPROM_512, 512, 0, false, 1, "eeprom 512 B write");
+  testChip(AUXSPI_SIM_EEPROM, 0x2000, 0, false, 2, "eeprom 8 kB write");
+  testChip(AUXSPI_SIM_EEPROM, 0x10000, 0, false, 2, "eeprom 64 kB write");
+  testChip(AUXSPI_SIM_FRAM, 0x10000, 0, false, 2, "FRAM 64 kB write");
+  testChip(AUXSPI_SIM_FLASH, 0x40000, 0, false, 3, "Flash 256 kB write");
+  testChip(AUXSPI_SIM_FLASH, 0x80000, 0, true, 3, "Flash 512 kB (IR) write");
+  testIrWrites();
+  testEraseRange();
+  testChipList();
+  return checkDone();
+}
@@ -0,0 +1,143 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * test_gba.cpp: tests of gba.cpp against the simulated GBA save chips
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <nds.h>
+
+#include "check.h"
+#include "gba.h"
+#include "gba_sim.h"
+#include "globals.h"
+
+static u8 save[0x20000], back[0x20000];
+
+// local function
+void fillRandom(u8 *buf, u32 len) {
+  for (u32 i = 0; i < len; i++) buf[i] = rand();
+}
+
+// Writes a whole save the way a restore does, and reads it back.
+void testWriteRead(u8 type, u16 flash_id, const char *name) {
+  CHECK(gbaSimInit(type, flash_id));
+  u32 size = gbaGetSaveSize(type);
+  fillRandom(save, size);
+  if (type >= 4) CHECK(gbaFormatSave(type));
+  gbaSimResetStats();
+  CHECK(gbaWriteSave(0, save, size, type));
+  gbaSimReport(name);
+  CHECK(!memcmp(gbaSimMemory(), save, size));
+  memset(back, 0, size);
+  CHECK(gbaReadSave(back, 0, size, type));
+  CHECK(!memcmp(back, save, size));
+  gbaSimShutdown();
+}
+
+// Many small reads through one stream only switch the bank when they cross
+//  the 64k boundary.
+void testStreamBanks() {
+  CHECK(gbaSimInit(5));
+  fillRandom(gbaSimMemory(), 0x20000);
+  GbaSaveStream stream;
+  gbaStreamOpen(&stream, 5);
+  for (u32 ofs = 0; ofs < 0x20000; ofs += 0x100)
+    CHECK(gbaStreamRead(&stream, back + ofs, 0x100) == 0x100);
+  CHECK(!memcmp(back, gbaSimMemory(), 0x20000));
+  CHECK(gbaSimGetStats()->bank_switches <= 2);
+  CHECK(gbaStreamRead(&stream, back, 1) == 0);
+  CHECK(!gbaStreamSeek(&stream, 0x20001));
+  gbaSimShutdown();
+}
+
+// Erasing a sector in the second bank must not touch anything else.
+void testEraseSector() {
+  CHECK(gbaSimInit(5));
+  fillRandom(gbaSimMemory(), 0x20000);
+  memcpy(save, gbaSimMemory(), 0x20000);
+  CHECK(gbaEraseSector(0x13456, 5));
+  memset(save + 0x13000, 0xff, 0x1000);
+  CHECK(!memcmp(gbaSimMemory(), save, 0x20000));
+  CHECK(gbaSimGetStats()->sector_erases == 1);
+  CHECK(!gbaEraseSector(0, 3));
+  gbaSimShutdown();
+}
+
+// A damaged byte is found by the verify pass and its sector written again.
+void testVerify(u8 type, u16 flash_id) {
+  CHECK(gbaSimInit(type, flash_id));
+  u32 size = gbaGetSaveSize(type);
+  fillRandom(save, size);
+  if (type >= 4) gbaFormatSave(type);
+  gbaWriteSave(0, save, size, type);
+  CHECK(gbaVerifySave(0, save, size, type));
+
+  gbaSimMemory()[size - 100] ^= 0x10;
+  gbaSimResetStats();
+  CHECK(gbaVerifySave(0, save, size, type));
+  CHECK(!memcmp(gbaSimMemory(), save, size));
+  bool erases = (type >= 4) && (flash_id != 0x3d1f);
+  CHECK(gbaSimGetStats()->sector_erases == (erases ? 1u : 0u));
+  gbaSimShutdown();
+}
+
+// Atmel chips write 128 byte pages; a partial page keeps the rest of the page.
+void testAtmelPartialPage() {
+  CHECK(gbaSimInit(4, 0x3d1f));
+  fillRandom(gbaSimMemory(), 0x10000);
+  memcpy(save, gbaSimMemory(), 0x10000);
+  u8 patch[40];
+  fillRandom(patch, sizeof(patch));
+  GbaSaveStream stream;
+  gbaStreamOpen(&stream, 4);
+  CHECK(gbaStreamSeek(&stream, 0x1f0));
+  CHECK(gbaStreamWrite(&stream, patch, sizeof(patch)) == sizeof(patch));
+  memcpy(save + 0x1f0, patch, sizeof(patch));
+  CHECK(!memcmp(gbaSimMemory(), save, 0x10000));
+  gbaSimShutdown();
+}
+
+void testBackendSwitch() {
+  CHECK(gbaGetBackend() == &gbaSlot2Backend);
+  CHECK(gbaSimInit(3));
+  CHECK(gbaGetBackend() == &gbaSimBackend);
+  gbaSimShutdown();
+  CHECK(gbaGetBackend() == &gbaSlot2Backend);
+}
+
+int main() {
+  data = save;
+  size_buf = sizeof(save);
+  testBackendSwitch();
+  testWriteRead(3, 0, "SRAM 32k write");
+  testWriteRead(4, 0, "Flash 64k write");
+  testWriteRead(4, 0x3d1f, "Atmel 64k write");
+  testWriteRead(5, 0, "Flash 128k write");
+  testStreamBanks();
+  testEraseSector();
+  testVerify(3, 0);
+  testVerify(4, 0);
+  testVerify(4, 0x3d1f);
+  testVerify(5, 0);
+  testAtmelPartialPage();
+  return checkDone();
+}
@@ -0,0 +1,361 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * test_nor.cpp: tests of dsCard.cpp and the 3in1 restore against the
+ *  simulated 3in1
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <nds.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "auxspi.h"
+#include "auxspi_sim.h"
+#include "check.h"
+#include "crc32.h"
+#include "dsCard.h"
+#include "dsCard_sim.h"
+#include "globals.h"
+#include "hardware.h"
+#include "strings.h"
+#include "stubs.h"
+
+// local functions of hardware.cpp
+void hwWriteNorBlock(u32 i, u8 *buf, u32 len);
+bool hwStagePsram(FILE *file, u32 size);
+
+static u8 buffer[0x30000];
+static u8 save[0x80000], back[0x80000];
+
+// local function
+void fillRandom(u8 *buf, u32 len) {
+  for (u32 i = 0; i < len; i++) buf[i] = rand();
+}
+
+// The workflows never return, they halt after their last message.
+static jmp_buf halt;
+static int halt_id;
+
+void haltHook(int id) {
+  switch (id) {
+    case STR_HW_PLEASE_REBOOT:
+    case STR_HW_3IN1_PLEASE_REBOOT:
+    case STR_HW_3IN1_ERR_NOR:
+    case STR_HW_3IN1_ERR_IDMODE:
+    case STR_HW_3IN1_ERR_PSRAM:
+    case STR_HW_VERIFY_FAILED:
+    case STR_HW_RESTORE_NOT_STARTED:
+      halt_id = id;
+      longjmp(halt, 1);
+  }
+}
+
+// local function: the 3in1 only answers the ID commands with writes enabled
+u32 readId() {
+  OpenNorWrite();
+  u32 id = ReadNorFlashID();
+  chip_reset();
+  CloseNorWrite();
+  return id;
+}
+
+// Erases, writes and reads back a few blocks the way staging a save does.
+void testNor(u32 id, u32 buffer_words, bool bypass, const char *name) {
+  CHECK(norSimInit(id, buffer_words, bypass));
+  CHECK(readId() == id);
+
+  const u32 base = 0x40000, len = 0x40000;
+  fillRandom(norSimMemory() + base, len);
+  OpenNorWrite();
+  CHECK(!IsBlankNorFlash(base, len));
+  Block_Erase(base);
+  CHECK(IsBlankNorFlash(base, len));
+
+  fillRandom(save, len);
+  norSimResetStats();
+  for (u32 ofs = 0; ofs < len; ofs += 0x8000)
+    CHECK(WriteNorFlash(base + ofs, save + ofs, 0x8000));
+  norSimReport(name);
+  CHECK(!norSimGetStats()->aborts);
+  CHECK(!memcmp(norSimMemory() + base, save, len));
+  CHECK(Crc32NorFlash(0, base, len) == crc32(save, len));
+  ReadNorFlash(back, base + 0x2345, 0x1000);
+  CHECK(!memcmp(back, save + 0x2345, 0x1000));
+
+  // a few bits cleared in place, on either chip of the pair
+  u16 words[2] = {0x1234, 0x0000};
+  // the first block is made of smaller parameter blocks
+  fillRandom(norSimMemory(), 0x40000);
+  Block_Erase(0);
+  CHECK(IsBlankNorFlash(0, 0x40000));
+  CHECK(WriteNorWords(0x2000, words, 2));
+  CHECK(!memcmp(norSimMemory() + 0x2000, words, 4));
+  words[0] = 0x0234;
+  CHECK(WriteNorWords(0x2000, words, 1));
+  CHECK(((u16 *)norSimMemory())[0x1000] == 0x0234);
+  CHECK(WriteNorWords(0x10, words, 1));
+  CHECK(((u16 *)norSimMemory())[8] == 0x0234);
+  CloseNorWrite();
+
+  // the NOR below 32 MB can be read directly
+  OpenNorRead(base);
+  CHECK(!memcmp(GetNorBus()->window(FlashBase + base, len), save, len));
+  CloseNorWrite();
+
+  // the PSRAM
+  fillRandom(save, 0x10000);
+  OpenNorWrite();
+  WritePSram((u8 *)FlashBase + 0x1000, save, 0x10000);
+  ReadPSram((u8 *)FlashBase + 0x1000, back, 0x10000);
+  CloseNorWrite();
+  CHECK(!memcmp(back, save, 0x10000));
+  CHECK(!memcmp(norSimPsram() + 0x1000, save, 0x10000));
+  norSimShutdown();
+}
+
+// A chip that fails to program is reported, and left in a state where it can
+//  be read and written again. Staging halts on it, even without verifying.
+void testNorFailure(u32 id, u32 buffer_words, bool bypass) {
+  const u32 base = 0x40000;
+  CHECK(norSimInit(id, buffer_words, bypass));
+  CHECK(readId() == id);
+  fillRandom(save, 0x8000);
+  OpenNorWrite();
+  norSimFailPrograms(true);
+  CHECK(!WriteNorFlash(base, save, 0x8000));
+  norSimFailPrograms(false);
+  Block_Erase(base);
+  CHECK(IsBlankNorFlash(base, 0x8000));
+  CHECK(WriteNorFlash(base, save, 0x8000));
+  CHECK(!memcmp(norSimMemory() + base, save, 0x8000));
+  CloseNorWrite();
+
+  // the block is in use already, so only WriteNorFlash can fail
+  int verify = nor_verify;
+  nor_verify = NOR_VERIFY_NONE;
+  OpenNorWrite();
+  Block_Erase(base);
+  CloseNorWrite();
+  norSimFailPrograms(true);
+  halt_id = 0;
+  if (!setjmp(halt)) hwWriteNorBlock(0, save, 0x8000);
+  CHECK(halt_id == STR_HW_3IN1_ERR_NOR);
+  nor_verify = verify;
+  norSimShutdown();
+}
+
+// A save is staged on the 3in1 (NOR or PSRAM), the cards are swapped, and
+//  only what differs is written to the game.
+void testRestore3in1(u32 id, bool psram, const char *name) {
+  const u32 size = 0x80000;
+  CHECK(norSimInit(id));
+  CHECK(readId() == id);
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, size));
+  fillRandom(auxspi_sim_memory(), size);
+
+  // half of the save is the same as what the game has already
+  memcpy(save, auxspi_sim_memory(), size);
+  fillRandom(save + 0x12345, 0x100);
+  fillRandom(save + size / 2, size / 2);
+
+  norSimResetStats();
+  if (psram) {
+    FILE *file = fmemopen(save, size, "rb");
+    CHECK(hwStagePsram(file, size));
+    fclose(file);
+  } else {
+    hwFormatNor(1, size >> 18);
+    for (u32 i = 0; i < size / 0x8000; i++) {
+      memcpy(data, save + i * 0x8000, 0x8000);
+      hwWriteNorBlock(i, data, 0x8000);
+    }
+  }
+  norSimReport(name);
+
+  auxspi_sim_reset_stats();
+  halt_id = 0;
+  if (!setjmp(halt)) hwRestore3in1_b(size, psram);
+  CHECK(halt_id == STR_HW_PLEASE_REBOOT);
+  CHECK(slot_1_chip.size_log2 == 19);
+  CHECK(!memcmp(auxspi_sim_memory(), save, size));
+  // the unchanged sectors are left alone
+  CHECK(auxspi_sim_get_stats()->erases == 5);
+  auxspi_sim_report(name);
+
+  auxspi_sim_shutdown();
+  norSimShutdown();
+}
+
+// A game whose save chip ignores page programs (e.g. bad contacts): the
+//  transaction is dropped, so nothing is written.
+static bool deaf_mute;
+static u32 deaf_index;
+
+void deafOpen(uint8 device) {
+  deaf_mute = false;
+  deaf_index = 0;
+  auxspi_sim_transport.open(device);
+}
+
+uint8 deafTransfer(uint8 out) {
+  if ((deaf_index++ == 0) && (out == 0x02)) deaf_mute = true;
+  return deaf_mute ? 0xff : auxspi_sim_transport.transfer(out);
+}
+
+const AuxspiTransport deaf_transport = {deafOpen, deafTransfer,
+                                        auxspi_sim_transport.close,
+                                        auxspi_sim_transport.delay};
+
+// A restore that can not be read back, or that does not fit into the buffer,
+//  stops with an error instead of asking for a reboot.
+void testRestoreFailure() {
+  const u32 size = 0x80000;
+  CHECK(norSimInit(0x227E2218));
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, size));
+  fillRandom(auxspi_sim_memory(), size);
+  memcpy(back, auxspi_sim_memory(), size);
+  fillRandom(save, size);
+  FILE *file = fmemopen(save, size, "rb");
+  CHECK(hwStagePsram(file, size));
+  fclose(file);
+
+  auxspi_set_transport(&deaf_transport);
+  halt_id = 0;
+  if (!setjmp(halt)) hwRestore3in1_b(size, true);
+  CHECK(halt_id == STR_HW_VERIFY_FAILED);
+  auxspi_set_transport(&auxspi_sim_transport);
+
+  // the staging buffers need three blocks
+  memcpy(auxspi_sim_memory(), back, size);
+  size_buf = 0x20000;
+  halt_id = 0;
+  if (!setjmp(halt)) hwRestore3in1_b(size, true);
+  CHECK(halt_id == STR_HW_RESTORE_NOT_STARTED);
+  CHECK(!memcmp(auxspi_sim_memory(), back, size));
+  size_buf = sizeof(buffer);
+
+  auxspi_sim_shutdown();
+  norSimShutdown();
+}
+
+// Two games are staged with hwBackup3in1; the second one is a different save.
+static int staged;
+
+void stageHook(int id) {
+  if (id == STR_HW_3IN1_ANOTHER) {
+    if (++staged == 2) host_keys = KEY_B;
+    memcpy(auxspi_sim_memory(), save + 0x40000, 0x40000);
+  }
+  haltHook(id);
+}
+
+// local function: true if the reboot flag is set in the NOR
+bool rebootFlag() {
+  uint32 ime = hwGrab3in1();
+  ReadNorFlash(back, 0, 0x8000);
+  hwRelease3in1(ime);
+  dsCardData flag;
+  memcpy(&flag, back + 0x1000, sizeof(flag));
+  return (flag.data[0] == RS_BACKUP) && (flag.data[3] == 0xffff00ff);
+}
+
+// local function: true if "path" holds exactly "len" bytes of "buf"
+bool fileHolds(const char *path, const u8 *buf, u32 len) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  u32 in = fread(back, 1, sizeof(back), file);
+  fclose(file);
+  return (in == len) && !memcmp(back, buf, len);
+}
+
+// The reboot flag of a multi-game backup is only cleared once every staged
+//  save is on the card; a damaged slot is skipped.
+void testDumpSlots() {
+  CHECK(norSimInit(0x227E2218));
+  CHECK(auxspi_sim_init(AUXSPI_SIM_FLASH, 0x40000));
+  fillRandom(save, 0x80000);
+  memcpy(auxspi_sim_memory(), save, 0x40000);
+  staged = 0;
+  host_keys = KEY_A;
+  host_display_hook = stageHook;
+  halt_id = 0;
+  if (!setjmp(halt)) hwBackup3in1();
+  host_display_hook = haltHook;
+  CHECK(halt_id == STR_HW_3IN1_PLEASE_REBOOT);
+  CHECK(rebootFlag());
+  host_keys = KEY_B;
+  // the ROM's buffer is a power of 2, and the dump reads half of it at once
+  size_buf = 0x20000;
+
+  // the files can't be written: everything stays staged
+  strcpy(host_select_dir, "/nonexistent");
+  memcpy(buffer, back, 0x8000);
+  hwDump3in1Slots(buffer, 18, "POKEMON D");
+  CHECK(rebootFlag());
+
+  // the second slot is damaged
+  char dir[] = "/tmp/test_nor.XXXXXX";
+  CHECK(mkdtemp(dir));
+  strcpy(host_select_dir, dir);
+  norSimMemory()[0x80000 + 0x1234] ^= 0x10;
+  memcpy(buffer, back, 0x8000);
+  hwDump3in1Slots(buffer, 18, "POKEMON D");
+  CHECK(!rebootFlag());
+  char path[64];
+  sprintf(path, "%s/POKEMON D.0.sav", dir);
+  CHECK(fileHolds(path, save, 0x40000));
+  remove(path);
+  sprintf(path, "%s/POKEMON D.1.sav", dir);
+  CHECK(access(path, F_OK) != 0);
+  rmdir(dir);
+  strcpy(host_select_dir, ".");
+  size_buf = sizeof(buffer);
+  host_keys = KEY_A;
+
+  auxspi_sim_shutdown();
+  norSimShutdown();
+}
+
+int main() {
+  data = buffer;
+  size_buf = sizeof(buffer);
+  host_display_hook = haltHook;
+  host_keys = KEY_A;
+  memcpy(host_card_header.gameTitle, "POKEMON D", 9);
+  memcpy(host_card_header.gameCode, "ADAE", 4);
+
+  testNor(0x89168916, 32, true, "Intel 256 kB write");
+  testNor(0x227E2218, 16, true, "AMD 256 kB write");
+  testNor(0x227E2218, 0, true, "AMD 256 kB write (no buffer)");
+  testNor(0x227E2218, 0, false, "AMD 256 kB write (no bypass)");
+  testNor(0x227E2202, 32, true, "AMD (2 pairs) 256 kB write");
+  testNorFailure(0x89168916, 32, true);
+  testNorFailure(0x227E2218, 16, true);
+  testNorFailure(0x227E2218, 0, true);
+  testNorFailure(0x227E2218, 0, false);
+  testRestore3in1(0x227E2218, false, "restore via NOR");
+  testRestore3in1(0x89168916, false, "restore via NOR (Intel)");
+  testRestore3in1(0x227E2218, true, "restore via PSRAM");
+  testRestoreFailure();
+  testDumpSlots();
+  return checkDone();
+}
@@ -33,65 +33,209 @@
 #include "hardware.h"
 
 using std::max;
+using std::min;
 
 #include "auxspi_core.inc"
 
+const AuxspiTransport auxspi_slot1_transport = {auxspi_hw_open,
+                                                auxspi_hw_transfer,
+                                                auxspi_hw_close, swiDelay};
+
+const AuxspiTransport* auxspi_transport = &auxspi_slot1_transport;
+
+void auxspi_set_transport(const AuxspiTransport* transport) {
+  auxspi_transport = transport ? transport : &auxspi_slot1_transport;
+}
+
+const AuxspiTransport* auxspi_get_transport() { return auxspi_transport; }
+
 // ========================================================
-//  local functions
-uint8 jedec_table(uint32 id) {
-  switch (id) {
+// The list of known Flash chips, sorted by JEDEC ID (auxspi_find_chip does a
+//  binary search). Chips from the ini file are merged in at boot.
+#define JEDEC_BUILTIN 8
+static JedecChip jedec_chips[JEDEC_BUILTIN + JEDEC_USER_MAX] = {
+    // 8 MB (Band Brothers DX); which one? (more work is required to unlock
+    //  this save chip!)
+    {0x202017, 0x17, 256, 0},
     // 256 kB
-    case 0x204012:
-    case 0x621600:
-      return 0x12;
+    {0x204012, 0x12, 256, 0},
     // 512 kB
-    case 0x204013:
-    case 0x621100:
-      return 0x13;
+    {0x204013, 0x13, 256, 0},
     // 1 MB
-    case 0x204014:
-      return 0x14;
+    {0x204014, 0x14, 256, 0},
     // 2 MB (not sure if this exists, but I vaguely remember something...)
-    case 0x204015:
-      return 0x15;
+    {0x204015, 0x15, 256, 0},
     // 8 MB (Band Brothers DX)
-    case 0x202017:  // which one? (more work is required to unlock this save
-                    // chip!)
-    case 0x204017:
-      return 0x17;
-    default: {
-      for (int i = 0; i < EXTRA_ARRAY_SIZE; i++) {
-        if (extra_id[i] == id) return extra_size[i];
-      }
-      return 0;  // unknown save type!
-    }
-  };
+    {0x204017, 0x17, 256, 0},
+    // 512 kB
+    {0x621100, 0x13, 256, 0},
+    // 256 kB
+    {0x621600, 0x12, 256, 0},
+};
+static u32 jedec_count = JEDEC_BUILTIN;
+
+// local function: the index of the first chip with an ID >= "jedec"
+u32 jedec_index(uint32 jedec) {
+  u32 lo = 0, hi = jedec_count;
+  while (lo < hi) {
+    u32 mid = (lo + hi) / 2;
+    if (jedec_chips[mid].jedec < jedec)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+const JedecChip* auxspi_find_chip(uint32 jedec) {
+  u32 i = jedec_index(jedec);
+  if ((i < jedec_count) && (jedec_chips[i].jedec == jedec))
+    return &jedec_chips[i];
+  return NULL;  // unknown save type!
+}
+
+bool auxspi_add_chip(const JedecChip* chip) {
+  u32 i = jedec_index(chip->jedec);
+  if ((i >= jedec_count) || (jedec_chips[i].jedec != chip->jedec)) {
+    if (jedec_count >= JEDEC_BUILTIN + JEDEC_USER_MAX) return false;
+    memmove(&jedec_chips[i + 1], &jedec_chips[i],
+            (jedec_count - i) * sizeof(JedecChip));
+    jedec_count++;
+  }
+  jedec_chips[i] = *chip;
+  return true;
 }
 
-uint8 type2_size(auxspi_extra extra) {
+// ========================================================
+//  local functions
+
+// This is a destructive test (one byte is modified and restored), so it should
+//  be done only once per game.
+uint8 type2_size(const SaveChipInfo* chip) {
   static const uint32 offset0 = (8 * 1024 - 1);      //      8KB
   static const uint32 offset1 = (2 * 8 * 1024 - 1);  //      16KB
   u8 buf1;  //      +0k data        read -> write
   u8 buf2;  //      +8k data        read -> read
   u8 buf3;  //      +0k ~data          write
   u8 buf4;  //      +8k data new    comp buf2
-  auxspi_read_data(offset0, &buf1, 1, 2, extra);
-  auxspi_read_data(offset1, &buf2, 1, 2, extra);
+  auxspi_read_data(offset0, &buf1, 1, chip);
+  auxspi_read_data(offset1, &buf2, 1, chip);
   buf3 = ~buf1;
-  auxspi_write_data(offset0, &buf3, 1, 2, extra);
-  auxspi_read_data(offset1, &buf4, 1, 2, extra);
-  auxspi_write_data(offset0, &buf1, 1, 2, extra);
+  auxspi_write_data(offset0, &buf3, 1, chip);
+  auxspi_read_data(offset1, &buf4, 1, chip);
+  auxspi_write_data(offset0, &buf1, 1, chip);
   if (buf4 != buf2)  //      +8k
     return 0x0d;     //       8KB(64kbit)
   else
     return 0x10;  //      64KB(512kbit)
 }
 
-// ========================================================
-uint8 auxspi_save_type(auxspi_extra extra) {
-  uint32 jedec = auxspi_save_jedec_id(extra);    // 9f
-  int8 sr = auxspi_save_status_register(extra);  // 05
+// local function: selects the save chip for the next transaction. The
+//  calibrated IR settings are only checked on reads, so anything that writes
+//  or erases the chip uses the delay from the ini file and wakes the bridge up.
+inline void select_chip(const SaveChipInfo* chip, bool write = false) {
+  if ((chip->extra == AUXSPI_INFRARED) && write)
+    auxspi_disable_infrared_core(ir_delay, true);
+  else if (chip->extra == AUXSPI_INFRARED)
+    auxspi_disable_infrared_core(chip->ir_delay, !chip->ir_quick);
+  else if (chip->extra)
+    auxspi_disable_extra(chip->extra);
+}
+
+// The transfer loop of bulk reads runs from ITCM, so it is not slowed down by
+//  the (tiny) instruction cache competing with the data. It is unrolled, since
+//  the bus is fast enough that the loop overhead is noticeable.
+ITCM_CODE void auxspi_read_bulk(uint8* buf, uint32 cnt) {
+  if (auxspi_transport != &auxspi_slot1_transport) {
+    while (cnt--) *buf++ = auxspi_read();
+    return;
+  }
+  while (cnt >= 8) {
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    *buf++ = auxspi_hw_transfer(0);
+    cnt -= 8;
+  }
+  while (cnt--) *buf++ = auxspi_hw_transfer(0);
+}
 
+// Flash chips of up to 8 MB, in units of 4 kB: which ones are known to be
+//  blank (0xff) during this session. This is reset whenever a chip is
+//  identified, and updated on every write and erase.
+#define ERASE_UNIT_LOG2 12
+#define ERASE_UNITS (1 << (23 - ERASE_UNIT_LOG2))
+static u32 blank_map[ERASE_UNITS / 32];
+
+inline bool unit_is_blank(u32 unit) {
+  return blank_map[unit >> 5] & BIT(unit & 31);
+}
+
+// local function
+void mark_units(u32 addr, u32 len, bool blank) {
+  if (!len) return;
+  u32 last = min((addr + len - 1) >> ERASE_UNIT_LOG2, (u32)ERASE_UNITS - 1);
+  for (u32 unit = addr >> ERASE_UNIT_LOG2; unit <= last; unit++) {
+    if (blank)
+      blank_map[unit >> 5] |= BIT(unit & 31);
+    else
+      blank_map[unit >> 5] &= ~BIT(unit & 31);
+  }
+}
+
+// local function
+uint32 read_jedec(const SaveChipInfo* chip) {
+  uint32 id = 0;
+  select_chip(chip);
+  auxspi_open(0);
+  auxspi_write(0x9f);
+  id |= auxspi_read() << 16;
+  id |= auxspi_read() << 8;
+  id |= auxspi_read();
+  auxspi_close();
+  return id;
+}
+
+// local function: true if the chip answers reliably with the current settings
+bool ir_settings_work(SaveChipInfo* chip, const u8* ref, u32 len) {
+  u8 buf[32];
+  for (int i = 0; i < 4; i++) {
+    if (read_jedec(chip) != chip->jedec) return false;
+    auxspi_read_data(0, buf, len, chip);
+    if (memcmp(buf, ref, len)) return false;
+  }
+  return true;
+}
+
+// The IR bridge needs some time to switch to pass-through mode, which is paid
+//  for every single command. The default delay ("ir_delay" in the ini file)
+//  is very conservative, so we look for the shortest delay that still reads
+//  the chip reliably (and use twice that), and test if the bridge can be
+//  addressed without waking it up before every command. This is only tested
+//  with reads, so writes and erases keep the delay from the ini file.
+void calibrate_ir(SaveChipInfo* chip) {
+  u8 ref[32];
+  chip->ir_delay = ir_delay;
+  chip->ir_quick = false;
+  auxspi_read_data(0, ref, sizeof(ref), chip);
+
+  uint32 good = ir_delay;
+  for (uint32 d = ir_delay / 2; d >= 64; d /= 2) {
+    chip->ir_delay = d;
+    if (!ir_settings_work(chip, ref, sizeof(ref))) break;
+    good = d;
+  }
+  chip->ir_delay = min(good * 2, (uint32)ir_delay);
+
+  chip->ir_quick = true;
+  if (!ir_settings_work(chip, ref, sizeof(ref))) chip->ir_quick = false;
+}
+
+uint8 type_from_id(uint32 jedec, uint8 sr) {
   if ((sr & 0xfd) == 0xF0 && (jedec == 0x00ffffff)) return 1;
   if ((sr & 0xfd) == 0x00 && (jedec == 0x00ffffff)) return 2;
   if ((sr & 0xfd) == 0x00 && (jedec != 0x00ffffff)) return 3;
@@ -99,25 +243,58 @@ uint8 auxspi_save_type(auxspi_extra extra) {
   return 0;
 }
 
-uint32 auxspi_save_size(auxspi_extra extra) {
-  return 1 << auxspi_save_size_log_2(extra);
-}
-
-uint8 auxspi_save_size_log_2(auxspi_extra extra) {
-  uint8 type = auxspi_save_type(extra);
-  switch (type) {
+// ========================================================
+bool auxspi_identify(SaveChipInfo* chip, auxspi_extra extra) {
+  chip->extra = extra;
+  chip->subsector = false;
+  chip->page = 0;
+  chip->ir_delay = ir_delay;
+  chip->ir_quick = false;
+  chip->jedec = auxspi_save_jedec_id(extra);       // 9f
+  chip->sr = auxspi_save_status_register(extra);  // 05
+  chip->type = type_from_id(chip->jedec, chip->sr);
+  switch (chip->type) {
     case 1:
-      return 0x09;  // 512 bytes
+      chip->size_log2 = 0x09;  // 512 bytes
+      chip->page = 16;
       break;
     case 2:
-      return type2_size(extra);
+      chip->page = 32;
+      chip->size_log2 = type2_size(chip);
       break;
-    case 3:
-      return jedec_table(auxspi_save_jedec_id(extra));
+    case 3: {
+      const JedecChip* known = auxspi_find_chip(chip->jedec);
+      if (!known) {
+        chip->size_log2 = 0;
+        break;
+      }
+      chip->size_log2 = known->size_log2;
+      chip->page = known->page;
+      chip->subsector = known->flags & JEDEC_SUBSECTOR;
       break;
+    }
     default:
-      return 0;
+      chip->size_log2 = 0;
   }
+  if (chip->size_log2 && (extra == AUXSPI_INFRARED)) calibrate_ir(chip);
+  memset(blank_map, 0, sizeof(blank_map));
+  return chip->size_log2 > 0;
+}
+
+uint8 auxspi_save_type(auxspi_extra extra) {
+  uint32 jedec = auxspi_save_jedec_id(extra);    // 9f
+  int8 sr = auxspi_save_status_register(extra);  // 05
+  return type_from_id(jedec, sr);
+}
+
+uint32 auxspi_save_size(auxspi_extra extra) {
+  return 1 << auxspi_save_size_log_2(extra);
+}
+
+uint8 auxspi_save_size_log_2(auxspi_extra extra) {
+  SaveChipInfo chip;
+  auxspi_identify(&chip, extra);
+  return chip.size_log2;
 }
 
 uint32 auxspi_save_jedec_id(auxspi_extra extra) {
@@ -144,12 +321,12 @@ uint8 auxspi_save_status_register(auxspi_extra extra) {
   return sr;
 }
 
-void auxspi_read_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type,
-                      auxspi_extra extra) {
-  if (type == 0) type = auxspi_save_type(extra);
+void auxspi_read_data(uint32 addr, uint8* buf, uint32 cnt,
+                      const SaveChipInfo* chip) {
+  uint8 type = chip->type;
   if (type == 0) return;
 
-  if (extra) auxspi_disable_extra(extra);
+  select_chip(chip);
   auxspi_open(0);
   auxspi_write(0x03 | ((type == 1) ? addr >> 8 << 3 : 0));
 
@@ -163,37 +340,33 @@ void auxspi_read_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type,
 
   auxspi_write(addr & 0xFF);
 
-  while (cnt > 0) {
-    *buf++ = auxspi_read();
-    cnt--;
-  }
+  auxspi_read_bulk(buf, cnt);
 
   auxspi_close();
 }
 
-void auxspi_write_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type,
-                       auxspi_extra extra) {
-  if (type == 0) type = auxspi_save_type();
+void auxspi_write_data(uint32 addr, uint8* buf, uint32 cnt,
+                       const SaveChipInfo* chip, bool wait) {
+  uint8 type = chip->type;
   if (type == 0) return;
 
+  if (type == 3) mark_units(addr, cnt, false);
+
   uint32 addr_end = addr + cnt;
   int i;
-  int maxblocks = 32;
-  if (type == 1) maxblocks = 16;
-  if (type == 2) maxblocks = 32;
-  if (type == 3) maxblocks = 256;
+  int maxblocks = chip->page;
 
   // we can only write a finite amount of data at once, so we need a separate
   // loop
   //  for multiple passes.
   while (addr < addr_end) {
-    if (extra) auxspi_disable_extra(extra);
+    select_chip(chip, true);
     auxspi_open(0);
     // set WEL (Write Enable Latch)
     auxspi_write(0x06);
     auxspi_close_lite();
 
-    if (extra) auxspi_disable_extra(extra);
+    select_chip(chip, true);
     auxspi_open(0);
     // send initial "write" command
     if (type == 1) {
@@ -215,16 +388,47 @@ void auxspi_write_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type,
     }
     auxspi_close_lite();
 
-    // wait programming to finish
-    if (extra) auxspi_disable_extra(extra);
-    auxspi_open(0);
-    auxspi_write(5);
-    auxspi_wait_wip();
-    auxspi_wait_busy();
-    auxspi_close();
+    // wait programming to finish (except after the last block, if the caller
+    //  wants to do something else meanwhile)
+    if (wait || (addr < addr_end)) auxspi_wait(chip);
   }
 }
 
+bool auxspi_busy(const SaveChipInfo* chip) {
+  select_chip(chip, true);
+  auxspi_open(0);
+  auxspi_write(5);
+  bool busy = auxspi_read() & 0x01;  // WIP (Write In Progress)
+  auxspi_close();
+  return busy;
+}
+
+void auxspi_wait(const SaveChipInfo* chip) {
+  select_chip(chip, true);
+  auxspi_open(0);
+  auxspi_write(5);
+  auxspi_wait_wip();
+  auxspi_wait_busy();
+  auxspi_close();
+}
+
+#ifdef DEBUG
+void auxspi_benchmark(const SaveChipInfo* chip) {
+  static const uint32 len = 0x10000;
+  uint32 size = 1 << chip->size_log2;
+  if (!chip->type || (size > size_buf)) return;
+  uint32 total = min(len, size);
+
+  cpuStartTiming(0);
+  for (uint32 ofs = 0; ofs < total; ofs += 0x1000)
+    auxspi_read_data(ofs, data + ofs, min((uint32)0x1000, total - ofs), chip);
+  uint32 ticks = cpuEndTiming();
+  // timer ticks at BUS_CLOCK (33.5 MHz)
+  iprintf("type %i read: %lu KB/s\n", chip->type,
+          (uint32)((u64)total * BUS_CLOCK / 1024 / max(ticks, (uint32)1)));
+}
+#endif
+
 void auxspi_disable_extra(auxspi_extra extra) {
   switch (extra) {
     case AUXSPI_INFRARED:
@@ -296,17 +500,17 @@ void auxspi_disable_big_protection() {
   auxspi_close();
 }
 
-auxspi_extra auxspi_has_extra() {
+auxspi_extra auxspi_has_extra(SaveChipInfo* chip) {
   sysSetBusOwners(true, true);
+  SaveChipInfo tmp;
+  if (!chip) chip = &tmp;
 
   // Trying to read the save size in IR mode will fail on non-IR devices.
   // If we have success, it is an IR device.
-  u8 size2 = auxspi_save_size_log_2(AUXSPI_INFRARED);
-  if (size2 > 0) return AUXSPI_INFRARED;
+  if (auxspi_identify(chip, AUXSPI_INFRARED)) return AUXSPI_INFRARED;
 
   // It is not an IR game, so maybe it is a regular game.
-  u8 size1 = auxspi_save_size_log_2();
-  if (size1 > 0) return AUXSPI_DEFAULT;
+  if (auxspi_identify(chip, AUXSPI_DEFAULT)) return AUXSPI_DEFAULT;
 
 #if 0
     // EXPERIMENTAL: verify that flash cards do not answer with the same signature!
@@ -319,69 +523,85 @@ auxspi_extra auxspi_has_extra() {
 
   // TODO: add support for Pokemon Typing DS (as soon as we figure out how)
 
+  chip->extra = AUXSPI_FLASH_CARD;
+  chip->type = 0;
+  chip->size_log2 = 0;
   return AUXSPI_FLASH_CARD;
 }
 
-void auxspi_erase(auxspi_extra extra) {
-  uint8 type = auxspi_save_type(extra);
+void auxspi_erase(const SaveChipInfo* chip) {
+  uint8 type = chip->type;
   if (type == 3) {
-    uint8 size;
-    size = 1 << (auxspi_save_size_log_2(extra) - 16);
-    for (int i = 0; i < size; i++) {
-      if (extra) auxspi_disable_extra(extra);
-      auxspi_open(0);
-      // set WEL (Write Enable Latch)
-      auxspi_write(0x06);
-      auxspi_close_lite();
-
-      if (extra) auxspi_disable_extra(extra);
-      auxspi_open(0);
-      auxspi_write(0xd8);
-      auxspi_write(i);
-      auxspi_write(0);
-      auxspi_write(0);
-      auxspi_close_lite();
-
-      // wait for programming to finish
-      if (extra) auxspi_disable_extra(extra);
-      auxspi_open(0);
-      auxspi_write(5);
-      auxspi_wait_wip();
-      auxspi_wait_busy();
-      auxspi_close();
-    }
+    auxspi_erase_range(0, 1 << chip->size_log2, chip);
   } else {
-    int8 size = 1 << max(0, (auxspi_save_size_log_2(extra) - 15));
+    int8 size = 1 << max(0, (chip->size_log2 - 15));
     memset(data, 0, 0x8000);
     for (int i = 0; i < size; i++) {
-      auxspi_write_data(i << 15, data, 0x8000, type, extra);
+      auxspi_write_data(i << 15, data, 0x8000, chip);
     }
   }
 }
 
-void auxspi_erase_sector(u32 sector, auxspi_extra extra) {
-  uint8 type = auxspi_save_type(extra);
-  if (type == 3) {
-    if (extra) auxspi_disable_extra(extra);
-    auxspi_open(0);
-    // set WEL (Write Enable Latch)
-    auxspi_write(0x06);
-    auxspi_close_lite();
+// local function: sends an erase command; "cmd" is 0xd8 (64 kB) or 0x20 (4 kB)
+void erase_command(u8 cmd, u32 addr, const SaveChipInfo* chip) {
+  select_chip(chip, true);
+  auxspi_open(0);
+  // set WEL (Write Enable Latch)
+  auxspi_write(0x06);
+  auxspi_close_lite();
 
-    if (extra) auxspi_disable_extra(extra);
-    auxspi_open(0);
-    auxspi_write(0xd8);
-    auxspi_write(sector & 0xff);
-    auxspi_write((sector >> 8) & 0xff);
-    auxspi_write((sector >> 8) & 0xff);
-    auxspi_close_lite();
+  select_chip(chip, true);
+  auxspi_open(0);
+  auxspi_write(cmd);
+  auxspi_write((addr >> 16) & 0xff);
+  auxspi_write((addr >> 8) & 0xff);
+  auxspi_write(addr & 0xff);
+  auxspi_close_lite();
+}
 
-    // wait for programming to finish
-    if (extra) auxspi_disable_extra(extra);
-    auxspi_open(0);
-    auxspi_write(5);
-    auxspi_wait_wip();
-    auxspi_wait_busy();
-    auxspi_close();
+void auxspi_erase_sector(u32 sector, const SaveChipInfo* chip, bool wait) {
+  if (chip->type != 3) return;
+  erase_command(0xd8, sector << 16, chip);
+  mark_units(sector << 16, 0x10000, true);
+
+  // wait for programming to finish
+  if (wait) auxspi_wait(chip);
+}
+
+bool auxspi_is_blank(u32 addr, u32 len, const SaveChipInfo* chip) {
+  if (chip->type != 3) return false;
+  static u8 buf[1 << ERASE_UNIT_LOG2];
+  const u32 unit_size = 1 << ERASE_UNIT_LOG2;
+  u32 end = addr + len;
+  for (u32 ofs = addr & ~(unit_size - 1); ofs < end; ofs += unit_size) {
+    if (unit_is_blank(ofs >> ERASE_UNIT_LOG2)) continue;
+    // only whole units are tested, so we can remember the result
+    auxspi_read_data(ofs, buf, unit_size, chip);
+    const u32* buf4 = (const u32*)buf;
+    for (u32 i = 0; i < unit_size / 4; i++)
+      if (buf4[i] != 0xffffffff) return false;
+    mark_units(ofs, unit_size, true);
+  }
+  return true;
+}
+
+void auxspi_erase_range(u32 addr, u32 len, const SaveChipInfo* chip) {
+  if (chip->type != 3) return;
+  const u32 unit_size = 1 << ERASE_UNIT_LOG2;
+  u32 end = addr + len;
+  for (u32 sector = addr & ~0xffff; sector < end; sector += 0x10000) {
+    u32 from = max(addr, sector);
+    u32 to = min(end, sector + 0x10000);
+    // a sector is only partially covered: use 4 kB erases if possible
+    if (chip->subsector && ((from != sector) || (to != sector + 0x10000))) {
+      for (u32 ofs = from & ~(unit_size - 1); ofs < to; ofs += unit_size) {
+        if (auxspi_is_blank(ofs, unit_size, chip)) continue;
+        erase_command(0x20, ofs, chip);
+        mark_units(ofs, unit_size, true);
+        auxspi_wait(chip);
+      }
+    } else if (!auxspi_is_blank(from, to - from, chip)) {
+      auxspi_erase_sector(sector >> 16, chip);
+    }
   }
 }
@@ -60,22 +60,105 @@ typedef enum {
   AUXSPI_FLASH_CARD = 999
 } auxspi_extra;
 
+// All accesses to the AUXSPI bus go through a transport. On real hardware,
+//  this is the Slot 1 bus; a simulator of the various save chips for
+//  host-side testing is found in arm9/host/auxspi_sim.h/.cpp (not part of the
+//  ROM).
+// "open" starts a transaction ("device" selects the clock: 0 for 4 MHz, 2 for
+//  the 1 MHz of the IR bridge), "close" ends it; "lite" only releases the chip
+//  select. "delay" uses the same units as swiDelay.
+struct AuxspiTransport {
+  void (*open)(uint8 device);
+  uint8 (*transfer)(uint8 out);
+  void (*close)(bool lite);
+  void (*delay)(uint32 count);
+};
+
+extern const AuxspiTransport auxspi_slot1_transport;
+
+// Passing NULL selects the real Slot 1 bus again.
+void auxspi_set_transport(const AuxspiTransport* transport);
+const AuxspiTransport* auxspi_get_transport();
+
+// Everything we need to know about the save chip of a game. This is resolved
+//  once per inserted game (auxspi_identify), since identifying a type 2 save
+//  means writing to it, and then passed to all functions accessing the save.
+struct SaveChipInfo {
+  auxspi_extra extra;
+  uint8 type;       // 1: small eeprom, 2: eeprom/FRAM, 3: Flash; 0: unknown
+  uint8 size_log2;  // 0 if the size is not known
+  uint32 jedec;     // JEDEC ID (0xffffff for types 1 and 2)
+  uint8 sr;         // status register at the time of identification
+  bool subsector;   // chip can erase 4 kB subsectors (0x20)
+  uint16 page;      // bytes per write command
+  // IR games only: the calibrated delay of the bridge, and whether it can be
+  //  addressed without waking it up first (for reads; writes and erases use
+  //  "ir_delay" from the ini file)
+  uint32 ir_delay;
+  bool ir_quick;
+};
+
+// The Flash chips (type 3) we know, by JEDEC ID. The built-in list is found in
+//  auxspi.cpp; more chips can be added from the ini file ([new chips]).
+struct JedecChip {
+  uint32 jedec;
+  uint8 size_log2;
+  uint16 page;  // page program size
+  uint8 flags;  // JEDEC_*
+};
+#define JEDEC_SUBSECTOR 0x01  // 4 kB subsector erase (0x20)
+
+// room for chips from the ini file
+#define JEDEC_USER_MAX 16
+
+// Adds a chip, replacing a known chip with the same ID. Returns false if the
+//  list is full.
+bool auxspi_add_chip(const JedecChip* chip);
+// Returns NULL if the chip is not known.
+const JedecChip* auxspi_find_chip(uint32 jedec);
+
+// Fills "chip" with the save chip found on the bus. Returns false if the chip
+//  is not known (type or size).
+bool auxspi_identify(SaveChipInfo* chip, auxspi_extra extra = AUXSPI_DEFAULT);
+
 // These functions reimplement relevant parts of "card.cpp", in a way that is
-// easier to modify.
+// easier to modify. They probe the chip on every call, so use them only if no
+// SaveChipInfo is at hand.
 uint8 auxspi_save_type(auxspi_extra extra = AUXSPI_DEFAULT);
 uint32 auxspi_save_size(auxspi_extra extra = AUXSPI_DEFAULT);
 uint8 auxspi_save_size_log_2(auxspi_extra extra = AUXSPI_DEFAULT);
 uint32 auxspi_save_jedec_id(auxspi_extra extra = AUXSPI_DEFAULT);
 uint8 auxspi_save_status_register(auxspi_extra extra = AUXSPI_DEFAULT);
-void auxspi_read_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type = 0,
-                      auxspi_extra extra = AUXSPI_DEFAULT);
-void auxspi_write_data(uint32 addr, uint8* buf, uint16 cnt, uint8 type = 0,
-                       auxspi_extra extra = AUXSPI_DEFAULT);
-void auxspi_erase(auxspi_extra extra = AUXSPI_DEFAULT);
-void auxspi_erase_sector(u32 sector, auxspi_extra extra = AUXSPI_DEFAULT);
-
-// These functions are used to identify exotic hardware.
-auxspi_extra auxspi_has_extra();
+
+void auxspi_read_data(uint32 addr, uint8* buf, uint32 cnt,
+                      const SaveChipInfo* chip);
+void auxspi_write_data(uint32 addr, uint8* buf, uint32 cnt,
+                       const SaveChipInfo* chip, bool wait = true);
+void auxspi_erase(const SaveChipInfo* chip);
+void auxspi_erase_sector(u32 sector, const SaveChipInfo* chip,
+                         bool wait = true);
+
+// Makes sure that the range is erased (on Flash chips), skipping everything
+//  that is already known or tested to be blank. Without 4 kB subsector erase,
+//  the rest of a 64 kB sector touched by the range is erased as well.
+void auxspi_erase_range(u32 addr, u32 len, const SaveChipInfo* chip);
+// Returns true if the range of a Flash chip is blank (0xff). Ranges that were
+//  erased or tested during this session are not read again.
+bool auxspi_is_blank(u32 addr, u32 len, const SaveChipInfo* chip);
+
+// With "wait = false", the functions above return while the chip is still
+//  busy programming/erasing. Use these before sending the next command.
+bool auxspi_busy(const SaveChipInfo* chip);
+void auxspi_wait(const SaveChipInfo* chip);
+
+#ifdef DEBUG
+// Prints the read throughput (KB/s) of the save chip.
+void auxspi_benchmark(const SaveChipInfo* chip);
+#endif
+
+// These functions are used to identify exotic hardware. If "chip" is given,
+//  it receives the save chip that was found along the way.
+auxspi_extra auxspi_has_extra(SaveChipInfo* chip = NULL);
 // bool auxspi_has_infrared();
 
 void auxspi_disable_extra(auxspi_extra extra = AUXSPI_DEFAULT);
@@ -0,0 +1,75 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * crc32.cpp: A table driven CRC32 implementation (slice-by-4).
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "crc32.h"
+
+#include <nds.h>
+
+// The tables (4 kB) live in DTCM, so the lookups do not compete with the data
+//  being hashed for the (tiny) data cache.
+DTCM_BSS static u32 crc_table[4][256];
+static bool crc_table_ready = false;
+
+// local function
+void crc32InitTable() {
+  for (u32 i = 0; i < 256; i++) {
+    u32 c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+    crc_table[0][i] = c;
+  }
+  for (u32 i = 0; i < 256; i++) {
+    u32 c = crc_table[0][i];
+    for (int t = 1; t < 4; t++) {
+      c = crc_table[0][c & 0xff] ^ (c >> 8);
+      crc_table[t][i] = c;
+    }
+  }
+  crc_table_ready = true;
+}
+
+u32 crc32Update(u32 crc, const u8 *buf, u32 len) {
+  if (!crc_table_ready) crc32InitTable();
+
+  crc = ~crc;
+  // bytewise until we are word aligned
+  while (len && ((u32)buf & 3)) {
+    crc = crc_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    len--;
+  }
+  // four bytes per step (the DS is little endian)
+  const u32 *buf4 = (const u32 *)buf;
+  while (len >= 4) {
+    crc ^= *buf4++;
+    crc = crc_table[3][crc & 0xff] ^ crc_table[2][(crc >> 8) & 0xff] ^
+          crc_table[1][(crc >> 16) & 0xff] ^ crc_table[0][crc >> 24];
+    len -= 4;
+  }
+  buf = (const u8 *)buf4;
+  while (len--) {
+    crc = crc_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
@@ -0,0 +1,37 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * crc32.h: header file for crc32.cpp
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <nds.h>
+
+// Standard CRC32 (as used by zip), so values can be compared with desktop
+//  tools. To hash data in several pieces, start with crc = 0 and pass the
+//  result of the previous call.
+u32 crc32Update(u32 crc, const u8 *buf, u32 len);
+inline u32 crc32(const u8 *buf, u32 len) { return crc32Update(0, buf, len); }
+
+#endif  // CRC32_H
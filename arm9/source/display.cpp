@@ -184,8 +184,8 @@ void displayPrintUpper(bool fc) {
   if (slot_1_type == AUXSPI_FLASH_CARD) {
     sprintf(&name[0], "Flash Card");
   } else {
-    uint8 type = auxspi_save_type(slot_1_type);
-    uint8 size = auxspi_save_size_log_2(slot_1_type);
+    uint8 type = slot_1_chip.type;
+    uint8 size = slot_1_chip.size_log2;
     // some debug output may need this so iprintf prints to the correct region
     consoleSetWindow(&upperScreen, 10, 5, 22, 1);
     switch (type) {
@@ -198,7 +198,7 @@ void displayPrintUpper(bool fc) {
       case 3:
         if (size == 0)
           sprintf(&name[0], "Flash (ID:%lx)",
-                  auxspi_save_jedec_id(slot_1_type));
+                  slot_1_chip.jedec);
         else
           sprintf(&name[0], "Flash (%i kB)", 1 << (size - 10));
         break;
@@ -605,8 +605,8 @@ void displayPrintUpper(bool fc) {
   if (slot_1_type == AUXSPI_FLASH_CARD) {
     sprintf(&name[0], "Flash Card");
   } else {
-    uint8 type = auxspi_save_type(slot_1_type);
-    uint8 size = auxspi_save_size_log_2(slot_1_type);
+    uint8 type = slot_1_chip.type;
+    uint8 size = slot_1_chip.size_log2;
     // some debug output may need this so iprintf prints to the correct region
     consoleSetWindow(&upperScreen, 10, 5, 22, 1);
     switch (type) {
@@ -619,7 +619,7 @@ void displayPrintUpper(bool fc) {
       case 3:
         if (size == 0)
           sprintf(&name[0], "Flash (ID:%lx)",
-                  auxspi_save_jedec_id(slot_1_type));
+                  slot_1_chip.jedec);
         else
           sprintf(&name[0], "Flash (%i kB)", 1 << (size - 10));
         break;
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 
+#include "crc32.h"
 #include "string.h"
 
 #ifdef __cplusplus
@@ -38,6 +39,26 @@ extern "C" {
 // anything else!
 uint32 ID;
 
+// ---------------------------------------------------
+// The Slot 2 bus, or whatever was set up instead (see SetNorBus).
+static u16 Slot2Read16(u32 addr) { return *(vu16 *)addr; }
+static void Slot2Write16(u32 addr, u16 value) { *(vu16 *)addr = value; }
+static u8 Slot2Read8(u32 addr) { return *(vu8 *)addr; }
+static void Slot2Write8(u32 addr, u8 value) { *(vu8 *)addr = value; }
+static const u8 *Slot2Window(u32 addr, u32 len) { return (const u8 *)addr; }
+
+const NorBus slot2NorBus = {Slot2Read16, Slot2Write16, Slot2Read8,
+                            Slot2Write8, Slot2Window};
+
+static const NorBus *bus = &slot2NorBus;
+
+void SetNorBus(const NorBus *b) { bus = b ? b : &slot2NorBus; }
+
+const NorBus *GetNorBus() { return bus; }
+
+static inline u16 NorIn(u32 addr) { return bus->read16(addr); }
+static inline void NorOut(u32 addr, u16 value) { bus->write16(addr, value); }
+
 //&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&
 //---------------------------------------------------
 // DS  
@@ -52,158 +73,196 @@ void Enable_Arm7DS() {
 }
 
 void OpenNorWrite() {
-  *(vuint16 *)0x9fe0000 = 0xd200;
-  *(vuint16 *)0x8000000 = 0x1500;
-  *(vuint16 *)0x8020000 = 0xd200;
-  *(vuint16 *)0x8040000 = 0x1500;
-  *(vuint16 *)0x9C40000 = 0x1500;
-  *(vuint16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9C40000, 0x1500);
+  NorOut(0x9fc0000, 0x1500);
 }
 
 void CloseNorWrite() {
-  *(vuint16 *)0x9fe0000 = 0xd200;
-  *(vuint16 *)0x8000000 = 0x1500;
-  *(vuint16 *)0x8020000 = 0xd200;
-  *(vuint16 *)0x8040000 = 0x1500;
-  *(vuint16 *)0x9C40000 = 0xd200;
-  *(vuint16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9C40000, 0xd200);
+  NorOut(0x9fc0000, 0x1500);
 }
 
 void SetRompage(u16 page) {
-  *(vuint16 *)0x9fe0000 = 0xd200;
-  *(vuint16 *)0x8000000 = 0x1500;
-  *(vuint16 *)0x8020000 = 0xd200;
-  *(vuint16 *)0x8040000 = 0x1500;
-  *(vuint16 *)0x9880000 = page;
-  *(vuint16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9880000, page);
+  NorOut(0x9fc0000, 0x1500);
 }
 void SetRampage(u16 page) {
-  *(vu16 *)0x9fe0000 = 0xd200;
-  *(vu16 *)0x8000000 = 0x1500;
-  *(vu16 *)0x8020000 = 0xd200;
-  *(vu16 *)0x8040000 = 0x1500;
-  *(vu16 *)0x9c00000 = page;
-  *(vu16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9c00000, page);
+  NorOut(0x9fc0000, 0x1500);
 }
 void SetSerialMode() {
-  *(vu16 *)0x9fe0000 = 0xd200;
-  *(vu16 *)0x8000000 = 0x1500;
-  *(vu16 *)0x8020000 = 0xd200;
-  *(vu16 *)0x8040000 = 0x1500;
-  *(vu16 *)0x9A40000 = 0xe200;
-  *(vu16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9A40000, 0xe200);
+  NorOut(0x9fc0000, 0x1500);
 }
+// What the NOR chips can do, found by ReadNorFlashID: the size of the write
+//  buffer (in words, 0 if there is none), and if the AMD style chips take
+//  programming commands without the unlock cycles ("unlock bypass").
+static u32 nor_buffer = 0;
+static bool nor_bypass = true;
+
+// Reads the write buffer size of both chips from their CFI data. Returns 0 if
+//  there is none, or if the chips don't answer; "reset" leaves CFI mode.
+static u32 QueryNorBuffer(u16 reset) {
+  u32 words = 32;  // we never use more than that
+  NorOut(FlashBase + 0x55 * 2, 0x98);
+  NorOut(FlashBase + 0x2000 + 0x55 * 2, 0x98);
+  for (u32 chip = 0; chip < 0x4000; chip += 0x2000) {
+    u32 cfi = FlashBase + chip;
+    if (((NorIn(cfi + 0x10 * 2) & 0xff) != 'Q') ||
+        ((NorIn(cfi + 0x11 * 2) & 0xff) != 'R') ||
+        ((NorIn(cfi + 0x12 * 2) & 0xff) != 'Y')) {
+      words = 0;
+      break;
+    }
+    // 2^n bytes
+    u32 n = NorIn(cfi + 0x2a * 2) & 0xff;
+    u32 chip_words = (n >= 1) && (n < 16) ? (1 << n) / 2 : 0;
+    if (chip_words < words) words = chip_words;
+  }
+  NorOut(FlashBase, reset);
+  NorOut(FlashBase + 0x2000, reset);
+  return (words >= 2) ? words : 0;
+}
+
+static uint32 SetNorID(uint32 id) {
+  ID = id;
+  nor_bypass = true;
+  if (id == 0x89168916) {
+    nor_buffer = QueryNorBuffer(0xFF);
+    // the fixed size that was always used for these chips
+    if (!nor_buffer) nor_buffer = 16;
+  } else {
+    nor_buffer = QueryNorBuffer(0xF0);
+  }
+  return id;
+}
+
 uint32 ReadNorFlashID() {
   // This function was damaged on the original sample, "ID mode" was never left.
   // It is fixed now.
   vuint16 id1, id2, id3, id4;
   ID = 0;
   // check intel 512M 3in1 card
-  *((vuint16 *)(FlashBase + 0)) = 0xFF;
-  *((vuint16 *)(FlashBase + 0x1000 * 2)) = 0xFF;
-  *((vuint16 *)(FlashBase + 0)) = 0x90;
-  *((vuint16 *)(FlashBase + 0x1000 * 2)) = 0x90;
-  id1 = *((vuint16 *)(FlashBase + 0));
-  id2 = *((vuint16 *)(FlashBase + 0x1000 * 2));
-  id3 = *((vuint16 *)(FlashBase + 1 * 2));
-  id4 = *((vuint16 *)(FlashBase + 0x1001 * 2));
+  NorOut(FlashBase + 0, 0xFF);
+  NorOut(FlashBase + 0x1000 * 2, 0xFF);
+  NorOut(FlashBase + 0, 0x90);
+  NorOut(FlashBase + 0x1000 * 2, 0x90);
+  id1 = NorIn(FlashBase + 0);
+  id2 = NorIn(FlashBase + 0x1000 * 2);
+  id3 = NorIn(FlashBase + 1 * 2);
+  id4 = NorIn(FlashBase + 0x1001 * 2);
   if (id3 == 0x8810) id3 = 0x8816;
   if (id4 == 0x8810) id4 = 0x8816;
   if ((id1 == 0x89) && (id2 == 0x89) && (id3 == 0x8816) && (id4 == 0x8816)) {
-    ID = 0x89168916;
-    return 0x89168916;
+    return SetNorID(0x89168916);
   }
   //256M
-  *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-  *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-  *((vuint16 *)(FlashBase + 0x555 * 2)) = 0x90;
+  NorOut(FlashBase + 0x555 * 2, 0xAA);
+  NorOut(FlashBase + 0x2AA * 2, 0x55);
+  NorOut(FlashBase + 0x555 * 2, 0x90);
 
-  *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-  *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-  *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0x90;
+  NorOut(FlashBase + 0x1555 * 2, 0xAA);
+  NorOut(FlashBase + 0x12AA * 2, 0x55);
+  NorOut(FlashBase + 0x1555 * 2, 0x90);
 
-  id1 = *((vuint16 *)(FlashBase + 0x2));
-  id2 = *((vuint16 *)(FlashBase + 0x2002));
+  id1 = NorIn(FlashBase + 0x2);
+  id2 = NorIn(FlashBase + 0x2002);
   if ((id1 != 0x227E) || (id2 != 0x227E)) {
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xf0;
+    NorOut(FlashBase + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + 0x555 * 2, 0xf0);
 
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xf0;
+    NorOut(FlashBase + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + 0x1555 * 2, 0xf0);
 
     return 0;
   }
 
-  id1 = *((vuint16 *)(FlashBase + 0xE * 2));
-  id2 = *((vuint16 *)(FlashBase + 0x100e * 2));
+  id1 = NorIn(FlashBase + 0xE * 2);
+  id2 = NorIn(FlashBase + 0x100e * 2);
   if (id1 == 0x2218 && id2 == 0x2218)  // H6H6
   {
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xf0;
-
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xf0;
-    ID = 0x227E2218;
-    return 0x227E2218;
+    NorOut(FlashBase + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + 0x555 * 2, 0xf0);
+
+    NorOut(FlashBase + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + 0x1555 * 2, 0xf0);
+    return SetNorID(0x227E2218);
   }
 
   if (id1 == 0x2202 && id2 == 0x2202)  // VZ064
   {
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xf0;
-
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xf0;
-    ID = 0x227E2202;
-    return 0x227E2202;
+    NorOut(FlashBase + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + 0x555 * 2, 0xf0);
+
+    NorOut(FlashBase + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + 0x1555 * 2, 0xf0);
+    return SetNorID(0x227E2202);
   }
   if (id1 == 0x2202 && id2 == 0x2220)  // VZ064
   {
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xf0;
-
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xf0;
-    ID = 0x227E2202;
-    return 0x227E2202;
+    NorOut(FlashBase + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + 0x555 * 2, 0xf0);
+
+    NorOut(FlashBase + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + 0x1555 * 2, 0xf0);
+    return SetNorID(0x227E2202);
   }
   if (id1 == 0x2202 && id2 == 0x2215)  // VZ064
   {
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x2AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x555 * 2)) = 0xf0;
-
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xAA;
-    *((vuint16 *)(FlashBase + 0x12AA * 2)) = 0x55;
-    *((vuint16 *)(FlashBase + 0x1555 * 2)) = 0xf0;
-    ID = 0x227E2202;
-    return 0x227E2202;
+    NorOut(FlashBase + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + 0x555 * 2, 0xf0);
+
+    NorOut(FlashBase + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + 0x1555 * 2, 0xf0);
+    return SetNorID(0x227E2202);
   }
 
   return 0;
 }
 void chip_reset() {
   if (ID == 0x89168916) {
-    *((vuint16 *)(FlashBase + 0)) = 0x50;
-    *((vuint16 *)(FlashBase + 0x1000 * 2)) = 0x50;
-    *((vuint16 *)(FlashBase + 0)) = 0xFF;
-    *((vuint16 *)(FlashBase + 0x1000 * 2)) = 0xFF;
+    NorOut(FlashBase + 0, 0x50);
+    NorOut(FlashBase + 0x1000 * 2, 0x50);
+    NorOut(FlashBase + 0, 0xFF);
+    NorOut(FlashBase + 0x1000 * 2, 0xFF);
     return;
   }
-  *((vu16 *)(FlashBase)) = 0xF0;
-  *((vu16 *)(FlashBase + 0x1000 * 2)) = 0xF0;
+  NorOut(FlashBase, 0xF0);
+  NorOut(FlashBase + 0x1000 * 2, 0xF0);
 
   if (ID == 0x227E2202) {
-    *((vu16 *)(FlashBase + 0x1000000)) = 0xF0;
-    *((vu16 *)(FlashBase + 0x1000000 + 0x1000 * 2)) = 0xF0;
+    NorOut(FlashBase + 0x1000000, 0xF0);
+    NorOut(FlashBase + 0x1000000 + 0x1000 * 2, 0xF0);
   }
 }
 
@@ -224,38 +283,38 @@ void Block_EraseIntel(u32 blockAdd) {
   }
   if (blockAdd == 0) {
     for (loop = 0; loop < 0x40000; loop += 0x10000) {
-      *((vu16 *)(FlashBase + loop)) = 0x50;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0x50;
-      *((vu16 *)(FlashBase + loop)) = 0xFF;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0xFF;
-      *((vu16 *)(FlashBase + loop)) = 0x60;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0x60;
-      *((vu16 *)(FlashBase + loop)) = 0xD0;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0xD0;
-      *((vu16 *)(FlashBase + loop)) = 0x20;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0x20;
-      *((vu16 *)(FlashBase + loop)) = 0xD0;
-      *((vu16 *)(FlashBase + loop + 0x2000)) = 0xD0;
+      NorOut(FlashBase + loop, 0x50);
+      NorOut(FlashBase + loop + 0x2000, 0x50);
+      NorOut(FlashBase + loop, 0xFF);
+      NorOut(FlashBase + loop + 0x2000, 0xFF);
+      NorOut(FlashBase + loop, 0x60);
+      NorOut(FlashBase + loop + 0x2000, 0x60);
+      NorOut(FlashBase + loop, 0xD0);
+      NorOut(FlashBase + loop + 0x2000, 0xD0);
+      NorOut(FlashBase + loop, 0x20);
+      NorOut(FlashBase + loop + 0x2000, 0x20);
+      NorOut(FlashBase + loop, 0xD0);
+      NorOut(FlashBase + loop + 0x2000, 0xD0);
 
       do {
-        v1 = *((vu16 *)(FlashBase + loop));
-        v2 = *((vu16 *)(FlashBase + loop + 0x2000));
+        v1 = NorIn(FlashBase + loop);
+        v2 = NorIn(FlashBase + loop + 0x2000);
       } while ((v1 != 0x80) || (v2 != 0x80));
     }
   } else {
-    *((vu16 *)(FlashBase + blockAdd)) = 0xFF;
-    *((vu16 *)(FlashBase + blockAdd + 0x2000)) = 0xFF;
-    *((vu16 *)(FlashBase + blockAdd)) = 0x60;
-    *((vu16 *)(FlashBase + blockAdd + 0x2000)) = 0x60;
-    *((vu16 *)(FlashBase + blockAdd)) = 0xD0;
-    *((vu16 *)(FlashBase + blockAdd + 0x2000)) = 0xD0;
-    *((vu16 *)(FlashBase + blockAdd)) = 0x20;
-    *((vu16 *)(FlashBase + blockAdd + 0x2000)) = 0x20;
-    *((vu16 *)(FlashBase + blockAdd)) = 0xD0;
-    *((vu16 *)(FlashBase + blockAdd + 0x2000)) = 0xD0;
+    NorOut(FlashBase + blockAdd, 0xFF);
+    NorOut(FlashBase + blockAdd + 0x2000, 0xFF);
+    NorOut(FlashBase + blockAdd, 0x60);
+    NorOut(FlashBase + blockAdd + 0x2000, 0x60);
+    NorOut(FlashBase + blockAdd, 0xD0);
+    NorOut(FlashBase + blockAdd + 0x2000, 0xD0);
+    NorOut(FlashBase + blockAdd, 0x20);
+    NorOut(FlashBase + blockAdd + 0x2000, 0x20);
+    NorOut(FlashBase + blockAdd, 0xD0);
+    NorOut(FlashBase + blockAdd + 0x2000, 0xD0);
     do {
-      v1 = *((vu16 *)(FlashBase + blockAdd));
-      v2 = *((vu16 *)(FlashBase + blockAdd + 0x2000));
+      v1 = NorIn(FlashBase + blockAdd);
+      v2 = NorIn(FlashBase + blockAdd + 0x2000);
 
     } while ((v1 != 0x80) || (v2 != 0x80));
   }
@@ -277,114 +336,118 @@ void Block_Erase(u32 blockAdd) {
     Block_EraseIntel(blockAdd);
     return;
   }
+  // the reads (e.g. IsBlankNorFlash) leave the NOR write protected
+  CloseNorWrite();
+  SetRompage(0);
+  OpenNorWrite();
   if ((blockAdd >= 0x1000000) && (ID == 0x227E2202)) {
     off = 0x1000000;
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xF0;
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xF0;
+    NorOut(FlashBase + off + 0x555 * 2, 0xF0);
+    NorOut(FlashBase + off + 0x1555 * 2, 0xF0);
   } else
     off = 0;
   Address = blockAdd;
-  *((vu16 *)(FlashBase + 0x555 * 2)) = 0xF0;
-  *((vu16 *)(FlashBase + 0x1555 * 2)) = 0xF0;
+  NorOut(FlashBase + 0x555 * 2, 0xF0);
+  NorOut(FlashBase + 0x1555 * 2, 0xF0);
 
   if ((blockAdd == 0) || (blockAdd == 0x1FC0000) || (blockAdd == 0xFC0000) ||
       (blockAdd == 0x1000000)) {
     for (loop = 0; loop < 0x40000; loop += 0x8000) {
-      *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0x80;
-      *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + Address + loop)) = 0x30;
-
-      *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0x80;
-      *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + Address + loop + 0x2000)) = 0x30;
-
-      *((vu16 *)(FlashBase + off + 0x2555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x22AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x2555 * 2)) = 0x80;
-      *((vu16 *)(FlashBase + off + 0x2555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x22AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + Address + loop + 0x4000)) = 0x30;
-
-      *((vu16 *)(FlashBase + off + 0x3555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x32AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x3555 * 2)) = 0x80;
-      *((vu16 *)(FlashBase + off + 0x3555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x32AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + Address + loop + 0x6000)) = 0x30;
+      NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+      NorOut(FlashBase + off + 0x555 * 2, 0x80);
+      NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+      NorOut(FlashBase + Address + loop, 0x30);
+
+      NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+      NorOut(FlashBase + off + 0x1555 * 2, 0x80);
+      NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+      NorOut(FlashBase + Address + loop + 0x2000, 0x30);
+      // A busy chip ignores commands: the second parameter block of each
+      //  chip can only be erased once the first one is done.
       do {
-        v1 = *((vu16 *)(FlashBase + Address + loop));
-        v2 = *((vu16 *)(FlashBase + Address + loop));
+        v1 = NorIn(FlashBase + Address + loop);
+        v2 = NorIn(FlashBase + Address + loop);
       } while (v1 != v2);
       do {
-        v1 = *((vu16 *)(FlashBase + Address + loop + 0x2000));
-        v2 = *((vu16 *)(FlashBase + Address + loop + 0x2000));
+        v1 = NorIn(FlashBase + Address + loop + 0x2000);
+        v2 = NorIn(FlashBase + Address + loop + 0x2000);
       } while (v1 != v2);
+
+      NorOut(FlashBase + off + 0x2555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x22AA * 2, 0x55);
+      NorOut(FlashBase + off + 0x2555 * 2, 0x80);
+      NorOut(FlashBase + off + 0x2555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x22AA * 2, 0x55);
+      NorOut(FlashBase + Address + loop + 0x4000, 0x30);
+
+      NorOut(FlashBase + off + 0x3555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x32AA * 2, 0x55);
+      NorOut(FlashBase + off + 0x3555 * 2, 0x80);
+      NorOut(FlashBase + off + 0x3555 * 2, 0xAA);
+      NorOut(FlashBase + off + 0x32AA * 2, 0x55);
+      NorOut(FlashBase + Address + loop + 0x6000, 0x30);
       do {
-        v1 = *((vu16 *)(FlashBase + Address + loop + 0x4000));
-        v2 = *((vu16 *)(FlashBase + Address + loop + 0x4000));
+        v1 = NorIn(FlashBase + Address + loop + 0x4000);
+        v2 = NorIn(FlashBase + Address + loop + 0x4000);
       } while (v1 != v2);
       do {
-        v1 = *((vu16 *)(FlashBase + Address + loop + 0x6000));
-        v2 = *((vu16 *)(FlashBase + Address + loop + 0x6000));
+        v1 = NorIn(FlashBase + Address + loop + 0x6000);
+        v2 = NorIn(FlashBase + Address + loop + 0x6000);
       } while (v1 != v2);
     }
   } else {
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0x80;
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + Address)) = 0x30;
-
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0x80;
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + Address + 0x2000)) = 0x30;
+    NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + off + 0x555 * 2, 0x80);
+    NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + Address, 0x30);
+
+    NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + off + 0x1555 * 2, 0x80);
+    NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + Address + 0x2000, 0x30);
 
     do {
-      v1 = *((vu16 *)(FlashBase + Address));
-      v2 = *((vu16 *)(FlashBase + Address));
+      v1 = NorIn(FlashBase + Address);
+      v2 = NorIn(FlashBase + Address);
     } while (v1 != v2);
     do {
-      v1 = *((vu16 *)(FlashBase + Address + 0x2000));
-      v2 = *((vu16 *)(FlashBase + Address + 0x2000));
+      v1 = NorIn(FlashBase + Address + 0x2000);
+      v2 = NorIn(FlashBase + Address + 0x2000);
     } while (v1 != v2);
 
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0x80;
-    *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + Address + 0x20000)) = 0x30;
+    NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + off + 0x555 * 2, 0x80);
+    NorOut(FlashBase + off + 0x555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x2AA * 2, 0x55);
+    NorOut(FlashBase + Address + 0x20000, 0x30);
 
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0x80;
-    *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-    *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-    *((vu16 *)(FlashBase + Address + 0x2000 + 0x20000)) = 0x30;
+    NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + off + 0x1555 * 2, 0x80);
+    NorOut(FlashBase + off + 0x1555 * 2, 0xAA);
+    NorOut(FlashBase + off + 0x12AA * 2, 0x55);
+    NorOut(FlashBase + Address + 0x2000 + 0x20000, 0x30);
 
     do {
-      v1 = *((vu16 *)(FlashBase + Address + 0x20000));
-      v2 = *((vu16 *)(FlashBase + Address + 0x20000));
+      v1 = NorIn(FlashBase + Address + 0x20000);
+      v2 = NorIn(FlashBase + Address + 0x20000);
     } while (v1 != v2);
     do {
-      v1 = *((vu16 *)(FlashBase + Address + 0x2000 + 0x20000));
-      v2 = *((vu16 *)(FlashBase + Address + 0x2000 + 0x20000));
+      v1 = NorIn(FlashBase + Address + 0x2000 + 0x20000);
+      v2 = NorIn(FlashBase + Address + 0x2000 + 0x20000);
     } while (v1 != v2);
   }
 }
 void ReadNorFlash(u8 *pBuf, u32 address, u16 len) {
-  vu16 *p = (vu16 *)pBuf;
-  u32 loop;
   bool b512 = false;
   if (address >= 0x2000000)  // 256M
   {
@@ -399,22 +462,99 @@ void ReadNorFlash(u8 *pBuf, u32 address, u16 len) {
   Enable_Arm7DS();
   OpenNorWrite();
   if (ID == 0x89168916) {
-    *((vuint16 *)(FlashBase + address)) = 0x50;
-    *((vuint16 *)(FlashBase + address + 0x1000 * 2)) = 0x50;
-    *((vuint16 *)(FlashBase + address)) = 0xFF;
-    *((vuint16 *)(FlashBase + address + 0x1000 * 2)) = 0xFF;
+    NorOut(FlashBase + address, 0x50);
+    NorOut(FlashBase + address + 0x1000 * 2, 0x50);
+    NorOut(FlashBase + address, 0xFF);
+    NorOut(FlashBase + address + 0x1000 * 2, 0xFF);
+  }
+  memcpy(pBuf, bus->window(FlashBase + address, len), len);
+  CloseNorWrite();
+  Enable_Arm9DS();
+  if (b512 == true) {
+    SetRompage(0);
+  }
+}
+
+u32 Crc32NorFlash(u32 crc, u32 address, u32 len) {
+  bool b512 = false;
+  if (address >= 0x2000000)  // 256M
+  {
+    CloseNorWrite();
+    SetRompage(768);
+    address -= 0x2000000;
+    b512 = true;
+  } else {
+    CloseNorWrite();
+    SetRompage(0);
   }
-  for (loop = 0; loop < len / 2; loop++) {
-    p[loop] = *((vu16 *)(FlashBase + address + loop * 2));
+  Enable_Arm7DS();
+  OpenNorWrite();
+  if (ID == 0x89168916) {
+    NorOut(FlashBase + address, 0x50);
+    NorOut(FlashBase + address + 0x1000 * 2, 0x50);
+    NorOut(FlashBase + address, 0xFF);
+    NorOut(FlashBase + address + 0x1000 * 2, 0xFF);
   }
+  // the NOR is mapped, so there is no need to copy it first
+  crc = crc32Update(crc, bus->window(FlashBase + address, len), len);
   CloseNorWrite();
   Enable_Arm9DS();
   if (b512 == true) {
     SetRompage(0);
   }
+  return crc;
 }
 
-void WriteNorFlashINTEL(u32 address, u8 *buffer, u32 size) {
+bool IsBlankNorFlash(u32 address, u32 len) {
+  bool b512 = false;
+  if (address >= 0x2000000)  // 256M
+  {
+    CloseNorWrite();
+    SetRompage(768);
+    address -= 0x2000000;
+    b512 = true;
+  } else {
+    CloseNorWrite();
+    SetRompage(0);
+  }
+  Enable_Arm7DS();
+  OpenNorWrite();
+  if (ID == 0x89168916) {
+    NorOut(FlashBase + address, 0x50);
+    NorOut(FlashBase + address + 0x1000 * 2, 0x50);
+    NorOut(FlashBase + address, 0xFF);
+    NorOut(FlashBase + address + 0x1000 * 2, 0xFF);
+  }
+  bool blank = true;
+  const u32 *p = (const u32 *)bus->window(FlashBase + address, len);
+  for (u32 loop = 0; loop < len / 4; loop++) {
+    if (p[loop] != 0xffffffff) {
+      blank = false;
+      break;
+    }
+  }
+  CloseNorWrite();
+  Enable_Arm9DS();
+  if (b512 == true) {
+    SetRompage(0);
+  }
+  return blank;
+}
+
+void OpenNorRead(u32 address) {
+  CloseNorWrite();
+  SetRompage(0);
+  OpenNorWrite();
+  if (ID == 0x89168916) {
+    NorOut(FlashBase + address, 0x50);
+    NorOut(FlashBase + address + 0x1000 * 2, 0x50);
+    NorOut(FlashBase + address, 0xFF);
+    NorOut(FlashBase + address + 0x1000 * 2, 0xFF);
+  }
+}
+
+bool WriteNorFlashINTEL(u32 address, u8 *buffer, u32 size) {
+  bool ok = true;
   u32 mapaddress;
   u32 size2, lop, j;
   vu16 *buf = (vu16 *)buffer;
@@ -444,48 +584,52 @@ void WriteNorFlashINTEL(u32 address, u8 *buffer, u32 size) {
   mapaddress = address;
 
   //	_consolePrintf("WriteNorFlashINTEL begin\n");
-  for (j = 0; j < lop; j++) {
+  for (j = 0; ok && (j < lop); j++) {
     if (j != 0) {
       mapaddress += 0x4000;
       buf = (vu16 *)(buffer + 0x4000);
     }
-    for (loopwrite = 0; loopwrite < (size2); loopwrite += 64) {
+    for (loopwrite = 0; ok && (loopwrite < size2);
+         loopwrite += nor_buffer * 4) {
       //			_consolePrintf("WriteNorFlashINTEL begin 1\n");
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0x50;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0x50;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0xFF;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0xFF;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0xE8;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0xE8;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0x70;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0x70;
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0x50);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0x50);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0xFF);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0xFF);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0xE8);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0xE8);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0x70);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0x70);
       v1 = v2 = 0;
       while ((v1 != 0x80) || (v2 != 0x80)) {
-        v1 = *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1)));
-        v2 = *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000));
+        v1 = NorIn(FlashBase + mapaddress + (loopwrite >> 1));
+        v2 = NorIn(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000);
       }
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0x0F;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0x0F;
-      for (i = 0; i < 0x10; i++) {
-        *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + i * 2)) =
-            buf[(loopwrite >> 2) + i];
-        *((vu16 *)(FlashBase + mapaddress + 0x2000 + (loopwrite >> 1) +
-                   i * 2)) = buf[0x1000 + (loopwrite >> 2) + i];
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), nor_buffer - 1);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000,
+             nor_buffer - 1);
+      for (i = 0; i < nor_buffer; i++) {
+        NorOut(FlashBase + mapaddress + (loopwrite >> 1) + i * 2,
+               buf[(loopwrite >> 2) + i]);
+        NorOut(FlashBase + mapaddress + 0x2000 + (loopwrite >> 1) + i * 2,
+               buf[0x1000 + (loopwrite >> 2) + i]);
       }
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1))) = 0xD0;
-      *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000)) = 0xD0;
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0xD0);
+      NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0xD0);
       v1 = v2 = 0;
       //			_consolePrintf("WriteNorFlashINTEL begin 2\n");
-      while ((v1 != 0x80) || (v2 != 0x80)) {
-        v1 = *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1)));
-        v2 = *((vu16 *)(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000));
-        if ((v1 == 0x90) || (v2 == 0x90)) {
-          WriteSram(0xA000000, (u8 *)buf, 0x8000);
-          //					_consolePrintf("Err \n");
-          while (1)
-            ;
-          break;
-        }
+      while (!(v1 & 0x80) || !(v2 & 0x80)) {
+        v1 = NorIn(FlashBase + mapaddress + (loopwrite >> 1));
+        v2 = NorIn(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000);
+      }
+      // SR.4: program error, SR.3: no Vpp, SR.1: block locked; the status is
+      //  cleared and both chips are returned to reading
+      if ((v1 | v2) & 0x1a) {
+        NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0x50);
+        NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0x50);
+        NorOut(FlashBase + mapaddress + (loopwrite >> 1), 0xFF);
+        NorOut(FlashBase + mapaddress + (loopwrite >> 1) + 0x2000, 0xFF);
+        ok = false;
       }
       //			_consolePrintf("WriteNorFlashINTEL begin 3\n");
     }
@@ -495,29 +639,81 @@ void WriteNorFlashINTEL(u32 address, u8 *buffer, u32 size) {
     SetRompage(0);
     OpenNorWrite();
   }
+  return ok;
 }
 
-void WriteNorFlash(u32 address, u8 *buffer, u32 size) {
-  if (ID == 0x89168916) {
-    WriteNorFlashINTEL(address, buffer, size);
-    return;
+// Waits for an AMD style program to finish: DQ7 reads inverted until then.
+//  Returns false if the chip gives up (DQ5: time limit, DQ1: buffer abort).
+static bool WaitNorProgram(u32 addr, u16 value) {
+  u16 v;
+  do {
+    v = NorIn(addr);
+    if ((v & 0x80) == (value & 0x80)) return true;
+  } while (!(v & 0x22));
+  return (NorIn(addr) & 0x80) == (value & 0x80);
+}
+
+// Programs "n" words with the write buffer of one chip; "cmd" is where the
+//  chip takes its commands. The words must not cross a buffer boundary.
+static void ProgramNorBuffer(u32 cmd, u32 dst, vu16 *src, u32 n) {
+  NorOut(cmd + 0x555 * 2, 0xAA);
+  NorOut(cmd + 0x2AA * 2, 0x55);
+  NorOut(dst, 0x25);
+  NorOut(dst, n - 1);
+  for (u32 i = 0; i < n; i++) NorOut(dst + i * 2, src[i]);
+  NorOut(dst, 0x29);
+}
+
+// Returns a chip to reading after a failed program.
+static void ResetNor(u32 cmd) {
+  NorOut(cmd + 0x555 * 2, 0xAA);
+  NorOut(cmd + 0x2AA * 2, 0x55);
+  NorOut(cmd + 0x555 * 2, 0xF0);
+}
+
+// Programs a single word of one chip.
+static void ProgramNorWord(u32 cmd, u32 dst, u16 value) {
+  if (!nor_bypass) {
+    NorOut(cmd + 0x555 * 2, 0xAA);
+    NorOut(cmd + 0x2AA * 2, 0x55);
   }
+  NorOut(cmd + 0x555 * 2, 0xA0);
+  NorOut(dst, value);
+}
+
+static void SetNorBypass(u32 cmd, bool on) {
+  if (on) {
+    NorOut(cmd + 0x555 * 2, 0xAA);
+    NorOut(cmd + 0x2AA * 2, 0x55);
+    NorOut(cmd + 0x555 * 2, 0x20);
+  } else {
+    NorOut(cmd, 0x90);
+    NorOut(cmd, 0x00);
+  }
+}
+
+// AMD style chips: with a write buffer, a whole buffer is programmed per
+//  command; otherwise, the unlock cycles are sent only once ("unlock bypass").
+//  Both chips are programmed at the same time, then polled. "address" has to
+//  be aligned to 32 kB.
+bool WriteNorFlash(u32 address, u8 *buffer, u32 size) {
+  if (ID == 0x89168916) return WriteNorFlashINTEL(address, buffer, size);
+  bool ok = true;
   CloseNorWrite();
   SetRompage(0);
   OpenNorWrite();
-  vu16 v1, v2;
-  register u32 loopwrite;
   vu16 *buf = (vu16 *)buffer;
   u32 size2, lop;
   u32 mapaddress;
   u32 j;
-  v1 = 0;
-  v2 = 1;
   u32 off = 0;
   if ((address >= 0x1000000) && (ID == 0x227E2202)) {
     off = 0x1000000;
   } else
     off = 0;
+  // where the two chips take their commands
+  u32 cmd1 = FlashBase + off;
+  u32 cmd2 = FlashBase + off + 0x2000;
   if (size > 0x4000) {
     size2 = size >> 1;
     lop = 2;
@@ -526,96 +722,170 @@ void WriteNorFlash(u32 address, u8 *buffer, u32 size) {
     lop = 1;
   }
   mapaddress = address;
-  for (j = 0; j < lop; j++) {
+  if (!nor_buffer && nor_bypass) {
+    SetNorBypass(cmd1, true);
+    SetNorBypass(cmd2, true);
+  }
+  for (j = 0; ok && (j < lop); j++) {
     if (j != 0) {
       mapaddress += 0x4000;
       buf = (vu16 *)(buffer + 0x4000);
     }
-    for (loopwrite = 0; loopwrite < (size2 >> 2); loopwrite++) {
-      *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x2AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x555 * 2)) = 0xA0;
-      *((vu16 *)(FlashBase + mapaddress + loopwrite * 2)) = buf[loopwrite];
-
-      *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xAA;
-      *((vu16 *)(FlashBase + off + 0x12AA * 2)) = 0x55;
-      *((vu16 *)(FlashBase + off + 0x1555 * 2)) = 0xA0;
-      *((vu16 *)(FlashBase + mapaddress + 0x2000 + loopwrite * 2)) =
-          buf[0x1000 + loopwrite];
-      do {
-        v1 = *((vu16 *)(FlashBase + mapaddress + loopwrite * 2));
-        v2 = *((vu16 *)(FlashBase + mapaddress + loopwrite * 2));
-      } while (v1 != v2);
-      do {
-        v1 = *((vu16 *)(FlashBase + mapaddress + 0x2000 + loopwrite * 2));
-        v2 = *((vu16 *)(FlashBase + mapaddress + 0x2000 + loopwrite * 2));
-      } while (v1 != v2);
+    u32 dst1 = FlashBase + mapaddress;
+    u32 dst2 = FlashBase + mapaddress + 0x2000;
+    vu16 *src2 = buf + 0x1000;
+    u32 words = size2 >> 2;
+
+    if (nor_buffer) {
+      for (u32 w = 0; ok && (w < words); w += nor_buffer) {
+        u32 n = (words - w < nor_buffer) ? words - w : nor_buffer;
+        ProgramNorBuffer(cmd1, dst1 + w * 2, buf + w, n);
+        ProgramNorBuffer(cmd2, dst2 + w * 2, src2 + w, n);
+        u32 last = w + n - 1;
+        // on errors, leave the buffer mode and give up
+        if (!WaitNorProgram(dst1 + last * 2, buf[last])) {
+          ResetNor(cmd1);
+          ok = false;
+        }
+        if (!WaitNorProgram(dst2 + last * 2, src2[last])) {
+          ResetNor(cmd2);
+          ok = false;
+        }
+      }
+      continue;
     }
+
+    for (u32 w = 0; ok && (w < words); w++) {
+      // erased words don't need to be programmed
+      if ((buf[w] == 0xffff) && (src2[w] == 0xffff)) continue;
+      ProgramNorWord(cmd1, dst1 + w * 2, buf[w]);
+      ProgramNorWord(cmd2, dst2 + w * 2, src2[w]);
+      bool ok1 = WaitNorProgram(dst1 + w * 2, buf[w]);
+      bool ok2 = WaitNorProgram(dst2 + w * 2, src2[w]);
+      // Not all chips know the unlock bypass; they ignore the command, so
+      //  the word can be written again the regular way.
+      if (nor_bypass && ((NorIn(dst1 + w * 2) != buf[w]) ||
+                         (NorIn(dst2 + w * 2) != src2[w]))) {
+        SetNorBypass(cmd1, false);
+        SetNorBypass(cmd2, false);
+        NorOut(cmd1, 0xF0);
+        NorOut(cmd2, 0xF0);
+        nor_bypass = false;
+        w--;
+        continue;
+      }
+      if (!ok1) ResetNor(cmd1);
+      if (!ok2) ResetNor(cmd2);
+      ok = ok1 && ok2;
+    }
+  }
+  if (!nor_buffer && nor_bypass) {
+    SetNorBypass(cmd1, false);
+    SetNorBypass(cmd2, false);
+  }
+  return ok;
+}
+
+// Small updates (e.g. a few bits of a marker): each word is programmed on its
+//  own, with the full command sequence.
+bool WriteNorWords(u32 address, const u16 *words, u32 n) {
+  CloseNorWrite();
+  SetRompage(0);
+  OpenNorWrite();
+  bool ok = true;
+  if (ID == 0x89168916) {
+    for (u32 i = 0; ok && (i < n); i++) {
+      u32 dst = FlashBase + address + i * 2;
+      NorOut(dst, 0x50);
+      NorOut(dst, 0x40);
+      NorOut(dst, words[i]);
+      u16 status;
+      while (!((status = NorIn(dst)) & 0x80))
+        ;
+      NorOut(dst, 0xFF);
+      // SR.4: program error, SR.3: no Vpp, SR.1: block locked
+      ok = !(status & 0x1a) && (NorIn(dst) == words[i]);
+    }
+    return ok;
+  }
+  u32 off = ((address >= 0x1000000) && (ID == 0x227E2202)) ? 0x1000000 : 0;
+  u32 cmd = FlashBase + off + (address & 0x2000);
+  for (u32 i = 0; ok && (i < n); i++) {
+    u32 dst = FlashBase + address + i * 2;
+    NorOut(cmd + 0x555 * 2, 0xAA);
+    NorOut(cmd + 0x2AA * 2, 0x55);
+    NorOut(cmd + 0x555 * 2, 0xA0);
+    NorOut(dst, words[i]);
+    ok = WaitNorProgram(dst, words[i]);
+    if (!ok) NorOut(cmd, 0xF0);
+    ok = ok && (NorIn(dst) == words[i]);
   }
+  return ok;
 }
+
 void WriteSram(uint32 address, u8 *data, uint32 size) {
   uint32 i;
-  for (i = 0; i < size; i++) *(u8 *)(address + i) = data[i];
+  for (i = 0; i < size; i++) bus->write8(address + i, data[i]);
 }
 void ReadSram(uint32 address, u8 *data, uint32 size) {
   uint32 i;
   u16 *pData = (u16 *)data;
   for (i = 0; i < size; i += 2) {
-    pData[i >> 1] = *(u8 *)(address + i) + (*(u8 *)(address + i + 1) * 0x100);
+    pData[i >> 1] =
+        bus->read8(address + i) + (bus->read8(address + i + 1) * 0x100);
   }
 }
 
 void WritePSram(u8 *address, u8 *data, uint32 length) {
-  vuint16 *pPatch = NULL;
-  pPatch = (vuint16 *)address;
+  u32 pPatch = (u32)address;
   Enable_Arm7DS();
   CloseNorWrite();
   SetRompage(192);
   OpenNorWrite();
   for (u32 pi = 0; pi < length; pi += 2) {
-    pPatch[pi >> 1] = data[pi] + (data[pi + 1] << 8);
+    NorOut(pPatch + pi, data[pi] + (data[pi + 1] << 8));
   }
   CloseNorWrite();
   Enable_Arm9DS();
 }
 void ReadPSram(u8 *address, u8 *data, uint32 length) {
-  vuint16 *pPatch = NULL;
-  pPatch = (vuint16 *)address;
+  u32 pPatch = (u32)address;
   Enable_Arm7DS();
   CloseNorWrite();
   SetRompage(192);
   OpenNorWrite();
   for (u32 pi = 0; pi < length; pi += 2) {
-    data[pi] = pPatch[pi >> 1] & 0xff;
-    data[pi + 1] = (pPatch[pi >> 1] & 0xff00) >> 8;
+    u16 v = NorIn(pPatch + pi);
+    data[pi] = v & 0xff;
+    data[pi + 1] = (v & 0xff00) >> 8;
   }
   CloseNorWrite();
   Enable_Arm9DS();
 }
 void OpenRamWrite() {
-  *(vu16 *)0x9fe0000 = 0xd200;
-  *(vu16 *)0x8000000 = 0x1500;
-  *(vu16 *)0x8020000 = 0xd200;
-  *(vu16 *)0x8040000 = 0x1500;
-  *(vu16 *)0x9C40000 = 0xA500;
-  *(vu16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9C40000, 0xA500);
+  NorOut(0x9fc0000, 0x1500);
 }
 
 void CloseRamWrite() {
-  *(vu16 *)0x9fe0000 = 0xd200;
-  *(vu16 *)0x8000000 = 0x1500;
-  *(vu16 *)0x8020000 = 0xd200;
-  *(vu16 *)0x8040000 = 0x1500;
-  *(vu16 *)0x9C40000 = 0xA200;
-  *(vu16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9C40000, 0xA200);
+  NorOut(0x9fc0000, 0x1500);
 }
 void SetShake(u16 data) {
-  *(vuint16 *)0x9fe0000 = 0xd200;
-  *(vuint16 *)0x8000000 = 0x1500;
-  *(vuint16 *)0x8020000 = 0xd200;
-  *(vuint16 *)0x8040000 = 0x1500;
-  *(vuint16 *)0x9E20000 = data;
-  *(vuint16 *)0x9fc0000 = 0x1500;
+  NorOut(0x9fe0000, 0xd200);
+  NorOut(0x8000000, 0x1500);
+  NorOut(0x8020000, 0xd200);
+  NorOut(0x8040000, 0x1500);
+  NorOut(0x9E20000, data);
+  NorOut(0x9fc0000, 0x1500);
 }
 #ifdef __cplusplus
 }
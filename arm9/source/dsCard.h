@@ -69,6 +69,27 @@ void Enable_Arm9DS(void);
 //Ƿ𶯿ĺ
 #define FlashBase 0x08000000
 #define _Ez5PsRAM 0x08000000
+
+// All accesses to the 3in1 (NOR, PSRAM, SRAM and its control registers) go
+//  through a bus. On real hardware, this is the Slot 2 bus; a simulator of the
+//  3in1 for host-side testing is found in arm9/host/dsCard_sim.h/.cpp (not part
+//  of the ROM). Addresses are absolute (e.g. FlashBase + offset).
+// "window" returns a pointer for reading "len" bytes at "addr" directly (by
+//  CPU or DMA); it is only valid while the memory at "addr" is in read mode.
+struct NorBus {
+  u16 (*read16)(u32 addr);
+  void (*write16)(u32 addr, u16 value);
+  u8 (*read8)(u32 addr);
+  void (*write8)(u32 addr, u8 value);
+  const u8* (*window)(u32 addr, u32 len);
+};
+
+extern const struct NorBus slot2NorBus;
+
+// Passing NULL selects the real Slot 2 bus again.
+void SetNorBus(const struct NorBus* bus);
+const struct NorBus* GetNorBus();
+
 void OpenNorWrite();
 void CloseNorWrite();
 void SetRompage(u16 page);
@@ -80,7 +101,24 @@ uint32 ReadNorFlashID();
 void chip_reset();
 void Block_Erase(u32 blockAdd);
 void ReadNorFlash(u8* pBuf, u32 address, u16 len);
-void WriteNorFlash(u32 address, u8* buffer, u32 size);
+// Like ReadNorFlash, but returns the CRC32 of the data (continuing "crc")
+//  instead of copying it.
+u32 Crc32NorFlash(u32 crc, u32 address, u32 len);
+// Returns true if the range is erased (0xffff).
+bool IsBlankNorFlash(u32 address, u32 len);
+// Maps the NOR below 32 MB to FlashBase for reading, and leaves it mapped until
+//  CloseNorWrite(). Unlike ReadNorFlash, slot 1 stays with the ARM9, so files
+//  can be written while the NOR is copied by DMA.
+void OpenNorRead(u32 address);
+// Programs "size" bytes (up to 32 kB, at an address aligned to 32 kB) of the
+//  erased NOR. Returns false if a chip reports an error; the caller should
+//  still verify what it needs to be sure of.
+bool WriteNorFlash(u32 address, u8* buffer, u32 size);
+// Programs "n" words at "address" (below 32 MB, on one chip: the words must not
+//  cross an 8 kB boundary). Bits can only be cleared this way, so the new
+//  words must not set any bit that is 0 in the NOR. Returns false if the chip
+//  reports an error or the words don't read back.
+bool WriteNorWords(u32 address, const u16* words, u32 n);
 void WriteSram(uint32 address, u8* data, uint32 size);
 void ReadSram(uint32 address, u8* data, uint32 size);
 void SetShake(u16 data);
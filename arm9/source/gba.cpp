@@ -39,6 +39,7 @@
 
 #include <algorithm>
 
+#include "crc32.h"
 #include "display.h"
 #include "dsCard.h"
 #include "globals.h"
@@ -331,83 +332,209 @@ void gbaEepromWrite8Bytes(u8 *out, u32 addr, bool short_addr = false) {
 #endif
 }
 
-bool gbaReadSave(u8 *dst, u32 src, u32 len, u8 type) {
-  int nbanks = 2;  // for type 4,5
+// -----------------------------------------------------------
+// The real Slot-2 bus: save memory is mapped at 0x0A000000.
+u8 gbaSlot2Read8(u32 ofs) { return *(vu8 *)(0x0a000000 + ofs); }
+
+void gbaSlot2Write8(u32 ofs, u8 val) { *(vu8 *)(0x0a000000 + ofs) = val; }
+
+void gbaSlot2EepromWrite8(const u8 *in, u32 block, bool short_addr) {
+  gbaEepromWrite8Bytes((u8 *)in, block, short_addr);
+}
+
+const GbaSaveBackend gbaSlot2Backend = {gbaSlot2Read8, gbaSlot2Write8, swiDelay,
+                                        gbaEepromRead8Bytes,
+                                        gbaSlot2EepromWrite8};
+
+static const GbaSaveBackend *backend = &gbaSlot2Backend;
+
+void gbaSetBackend(const GbaSaveBackend *b) {
+  backend = b ? b : &gbaSlot2Backend;
+}
+
+const GbaSaveBackend *gbaGetBackend() { return backend; }
+
+inline u8 gbaSaveRead(u32 ofs) { return backend->read8(ofs); }
+inline void gbaSaveWrite(u32 ofs, u8 val) { backend->write8(ofs, val); }
+inline void gbaSaveDelay(u32 n) { backend->delay(n); }
+
+bool gbaIsAtmel();
+
+// local function
+void gbaFlashCommand(u8 cmd) {
+  // we need to wait a few cycles before the hardware reacts!
+  gbaSaveWrite(0x5555, 0xaa);
+  gbaSaveDelay(10);
+  gbaSaveWrite(0x2aaa, 0x55);
+  gbaSaveDelay(10);
+  gbaSaveWrite(0x5555, cmd);
+  gbaSaveDelay(10);
+}
+
+// local function
+void gbaFlashSelectBank(GbaSaveStream *stream, u8 bank) {
+  if (stream->bank == bank) return;
+  gbaFlashCommand(0xb0);
+  gbaSaveWrite(0x0000, bank);
+  gbaSaveDelay(10);
+  stream->bank = bank;
+}
+
+// local function: returns the number of bytes that may be accessed from the
+//  current position without crossing a Flash bank (or leaving the save)
+u32 gbaStreamSpan(GbaSaveStream *stream, u32 len) {
+  len = min(len, stream->size - stream->pos);
+  if ((stream->type == 4) || (stream->type == 5)) {
+    gbaFlashSelectBank(stream, stream->pos >> 16);
+    len = min(len, 0x10000 - (stream->pos & 0xffff));
+  }
+  return len;
+}
+
+// local function
+bool gbaStreamIsAtmel(GbaSaveStream *stream) {
+  if (stream->atmel < 0) stream->atmel = (stream->type == 4) && gbaIsAtmel();
+  return stream->atmel;
+}
+
+// local function
+void gbaAtmelWritePage(u32 page, const u8 *buf) {
+  // only 64k, no bank switching required
+  u32 ime = enterCriticalSection();
+  gbaFlashCommand(0xa0);
+  for (int i = 0; i < 0x80; i++) {
+    gbaSaveWrite(page + i, buf[i]);
+    gbaSaveDelay(10);
+  }
+  leaveCriticalSection(ime);
+  // the page is done as soon as the last byte reads back correctly
+  while (gbaSaveRead(page + 0x7f) != buf[0x7f]) {
+    gbaSaveDelay(10);
+  }
+}
+
+void gbaStreamOpen(GbaSaveStream *stream, u8 type) {
+  stream->type = type;
+  stream->pos = 0;
+  stream->size = (type == 0) ? 0 : gbaGetSaveSize(type);
+  stream->bank = -1;
+  stream->atmel = -1;
+}
+
+bool gbaStreamSeek(GbaSaveStream *stream, u32 pos) {
+  if (pos > stream->size) return false;
+  stream->pos = pos;
+  return true;
+}
+
+u32 gbaStreamRead(GbaSaveStream *stream, u8 *dst, u32 len) {
+  u32 done = 0;
   bool eeprom_long = true;
 
-  switch (type) {
-    case 1: {
+  switch (stream->type) {
+    case 1:
       eeprom_long = false;
-    }
-    case 2: {
-      int start, end;
-      start = src >> 3;
-      end = (src + len - 1) >> 3;
-      u8 *tmp = (u8 *)malloc((end - start + 1) << 3);
-      u8 *ptr = tmp;
-      for (int j = start; j <= end; j++, ptr += 8) {
-        gbaEepromRead8Bytes(ptr, j, eeprom_long);
+    case 2:
+      while ((done < len) && (stream->pos < stream->size)) {
+        u8 tmp[8];
+        u32 ofs = stream->pos & 7;
+        u32 sublen = min(min(len - done, 8 - ofs), stream->size - stream->pos);
+        backend->eepromRead8(tmp, stream->pos >> 3, eeprom_long);
+        memcpy(dst, &tmp[ofs], sublen);
+        dst += sublen;
+        done += sublen;
+        stream->pos += sublen;
       }
-      memcpy(dst, tmp, len);
-      free(tmp);
       break;
-    }
-    case 3: {
-      // SRAM: blind copy
-      int start = 0x0a000000 + src;
-      u8 *tmpsrc = (u8 *)start;
+    case 3:
+    case 4:
+    case 5:
+      // SRAM: blind copy. FLASH: select bank, then blind copy.
       sysSetBusOwners(true, true);
-      for (u32 i = 0; i < len; i++, tmpsrc++, dst++) *dst = *tmpsrc;
+      while ((done < len) && (stream->pos < stream->size)) {
+        u32 sublen = gbaStreamSpan(stream, len - done);
+        u32 ofs = stream->pos & 0xffff;
+        for (u32 i = 0; i < sublen; i++, ofs++, dst++) *dst = gbaSaveRead(ofs);
+        done += sublen;
+        stream->pos += sublen;
+      }
       break;
-    }
+  }
+  return done;
+}
+
+u32 gbaStreamWrite(GbaSaveStream *stream, const u8 *src, u32 len) {
+  u32 done = 0;
+
+  switch (stream->type) {
+    case 3:
     case 4:
-      // FLASH - must be opend by register magic, then blind copy
-      nbanks = 1;
     case 5:
-      for (int j = 0; j < nbanks; j++) {
-        // we need to wait a few cycles before the hardware reacts!
-        *(u8 *)0x0a005555 = 0xaa;
-        swiDelay(10);
-        *(u8 *)0x0a002aaa = 0x55;
-        swiDelay(10);
-        *(u8 *)0x0a005555 = 0xb0;
-        swiDelay(10);
-        *(u8 *)0x0a000000 = (u8)j;
-        swiDelay(10);
-        u32 start, sublen;
-        if (j == 0) {
-          start = 0x0a000000 + src;
-          sublen = (src < 0x10000) ? min(len, (1 << 16) - src) : 0;
-        } else if (j == 1) {
-          start = max(0x09ff0000 + src, 0x0a000000);
-          sublen = (src + len < 0x10000) ? 0 : min(len, len - (0x10000 - src));
+      sysSetBusOwners(true, true);
+      while ((done < len) && (stream->pos < stream->size)) {
+        u32 sublen = gbaStreamSpan(stream, len - done);
+        u32 ofs = stream->pos & 0xffff;
+        if (stream->type == 3) {
+          // SRAM: blind write
+          for (u32 i = 0; i < sublen; i++, ofs++, src++)
+            gbaSaveWrite(ofs, *src);
+          // mabe we don't need this, but better safe than sorry
+          gbaSaveDelay(10);
+        } else if (gbaStreamIsAtmel(stream)) {
+          // Atmel: 128 byte pages, partial pages are merged with the old data
+          for (u32 i = 0; i < sublen;) {
+            u32 page = ofs & ~0x7f;
+            u32 n = min(sublen - i, 0x80 - (ofs & 0x7f));
+            u8 tmp[0x80];
+            const u8 *buf = src;
+            if (n != 0x80) {
+              for (u32 j = 0; j < 0x80; j++) tmp[j] = gbaSaveRead(page + j);
+              memcpy(&tmp[ofs & 0x7f], src, n);
+              buf = tmp;
+            }
+            gbaAtmelWritePage(page, buf);
+            i += n;
+            ofs += n;
+            src += n;
+          }
+        } else {
+          for (u32 i = 0; i < sublen; i++, ofs++, src++) {
+            gbaFlashCommand(0xa0);  // write byte command
+            //
+            gbaSaveWrite(ofs, *src);
+            gbaSaveDelay(10);
+            //
+            while (gbaSaveRead(ofs) != *src) {
+              gbaSaveDelay(10);
+            }
+          }
         }
-        u8 *tmpsrc = (u8 *)start;
-        sysSetBusOwners(true, true);
-        for (u32 i = 0; i < sublen; i++, tmpsrc++, dst++) *dst = *tmpsrc;
+        done += sublen;
+        stream->pos += sublen;
       }
       break;
+    default:
+      // EEPROM writing is not supported yet
+      break;
   }
+  return done;
+}
+
+bool gbaReadSave(u8 *dst, u32 src, u32 len, u8 type) {
+  GbaSaveStream stream;
+  gbaStreamOpen(&stream, type);
+  if (!gbaStreamSeek(&stream, src)) return false;
+  gbaStreamRead(&stream, dst, len);
   return true;
 }
 
 bool gbaIsAtmel() {
-  *(u8 *)0x0a005555 = 0xaa;
-  swiDelay(10);
-  *(u8 *)0x0a002aaa = 0x55;
-  swiDelay(10);
-  *(u8 *)0x0a005555 = 0x90;  // ID mode
-  swiDelay(10);
+  gbaFlashCommand(0x90);  // ID mode
   //
-  u8 dev = *(u8 *)0x0a000001;
-  u8 man = *(u8 *)0x0a000000;
+  u8 dev = gbaSaveRead(0x0001);
+  u8 man = gbaSaveRead(0x0000);
   //
-  *(u8 *)0x0a005555 = 0xaa;
-  swiDelay(10);
-  *(u8 *)0x0a002aaa = 0x55;
-  swiDelay(10);
-  *(u8 *)0x0a005555 = 0xf0;  // leave ID mode
-  swiDelay(10);
+  gbaFlashCommand(0xf0);  // leave ID mode
   //
   // char txt[128];
   sprintf(txt, "Man: %x, Dev: %x", man, dev);
@@ -419,7 +546,6 @@ bool gbaIsAtmel() {
 }
 
 bool gbaWriteSave(u32 dst, u8 *src, u32 len, u8 type) {
-  int nbanks = 2;  // for type 4,5
   bool eeprom_long = true;
 
   switch (type) {
@@ -441,84 +567,16 @@ bool gbaWriteSave(u32 dst, u8 *src, u32 len, u8 type) {
           */
       break;
     }
-    case 3: {
+    default: {
       // SRAM: blind write
-      u32 start = 0x0a000000 + dst;
-      u8 *tmpdst = (u8 *)start;
-      sysSetBusOwners(true, true);
-      for (u32 i = 0; i < len; i++, tmpdst++, src++) *tmpdst = *src;
-      swiDelay(10);  // mabe we don't need this, but better safe than sorry
-      break;
-    }
-    case 4: {
-      bool atmel = gbaIsAtmel();
-      if (atmel) {
-        // only 64k, no bank switching required
-        u32 len7 = len >> 7;
-        u8 *tmpdst = (u8 *)(0x0a000000 + dst);
-        for (u32 j = 0; j < len7; j++) {
-          u32 ime = enterCriticalSection();
-          *(u8 *)0x0a005555 = 0xaa;
-          swiDelay(10);
-          *(u8 *)0x0a002aaa = 0x55;
-          swiDelay(10);
-          *(u8 *)0x0a005555 = 0xa0;
-          swiDelay(10);
-          for (int i = 0; i < 128; i++) {
-            *tmpdst = *src;
-            swiDelay(10);
-          }
-          leaveCriticalSection(ime);
-          while (*tmpdst != *src) {
-            swiDelay(10);
-          }
-        }
-        break;
-      }
-      nbanks = 1;
-    }
-    case 5:
       // FLASH - must be opend by register magic, erased and then rewritten
       // FIXME: currently, you can only write "all or nothing"
-      nbanks = 2;
-      for (int j = 0; j < nbanks; j++) {
-        *(u8 *)0x0a005555 = 0xaa;
-        swiDelay(10);
-        *(u8 *)0x0a002aaa = 0x55;
-        swiDelay(10);
-        *(u8 *)0x0a005555 = 0xb0;
-        swiDelay(10);
-        *(u8 *)0x0a000000 = (u8)j;
-        swiDelay(10);
-        //
-        u32 start, sublen;
-        if (j == 0) {
-          start = 0x0a000000 + dst;
-          sublen = (dst < 0x10000) ? min(len, (1 << 16) - dst) : 0;
-        } else if (j == 1) {
-          start = max(0x09ff0000 + dst, 0x0a000000);
-          sublen = (dst + len < 0x10000) ? 0 : min(len, len - (0x10000 - dst));
-        }
-        u8 *tmpdst = (u8 *)start;
-        sysSetBusOwners(true, true);
-        for (u32 i = 0; i < sublen; i++, tmpdst++, src++) {
-          // we need to wait a few cycles before the hardware reacts!
-          *(u8 *)0x0a005555 = 0xaa;
-          swiDelay(10);
-          *(u8 *)0x0a002aaa = 0x55;
-          swiDelay(10);
-          *(u8 *)0x0a005555 = 0xa0;  // write byte command
-          swiDelay(10);
-          //
-          *tmpdst = *src;
-          swiDelay(10);
-          //
-          while (*tmpdst != *src) {
-            swiDelay(10);
-          }
-        }
-      }
+      GbaSaveStream stream;
+      gbaStreamOpen(&stream, type);
+      if (!gbaStreamSeek(&stream, dst)) return false;
+      gbaStreamWrite(&stream, src, len);
       break;
+    }
   }
   return true;
 }
@@ -535,20 +593,75 @@ bool gbaFormatSave(u8 type) {
       break;
     case 4:
     case 5:
-      *(u8 *)0x0a005555 = 0xaa;
-      swiDelay(10);
-      *(u8 *)0x0a002aaa = 0x55;
-      swiDelay(10);
-      *(u8 *)0x0a005555 = 0x80;  // erase command
-      swiDelay(10);
-      *(u8 *)0x0a005555 = 0xaa;
-      swiDelay(10);
-      *(u8 *)0x0a002aaa = 0x55;
-      swiDelay(10);
-      *(u8 *)0x0a005555 = 0x10;  // erase entire chip
-      swiDelay(10);
-      while (*(u8 *)0x0a000000 != 0xff) swiDelay(10);
+      gbaFlashCommand(0x80);  // erase command
+      gbaFlashCommand(0x10);  // erase entire chip
+      while (gbaSaveRead(0x0000) != 0xff) gbaSaveDelay(10);
       break;
   }
   return true;
 }
+
+bool gbaEraseSector(u32 ofs, u8 type) {
+  if ((type != 4) && (type != 5)) return false;
+
+  GbaSaveStream stream;
+  gbaStreamOpen(&stream, type);
+  if (!gbaStreamSeek(&stream, ofs & ~0xfff)) return false;
+  gbaStreamSpan(&stream, 1);  // selects the bank
+
+  u32 sector = stream.pos & 0xf000;
+  gbaFlashCommand(0x80);  // erase command
+  gbaSaveWrite(0x5555, 0xaa);
+  gbaSaveDelay(10);
+  gbaSaveWrite(0x2aaa, 0x55);
+  gbaSaveDelay(10);
+  gbaSaveWrite(sector, 0x30);  // erase sector
+  gbaSaveDelay(10);
+  while (gbaSaveRead(sector) != 0xff) gbaSaveDelay(10);
+  return true;
+}
+
+// local function: CRC32 of what is currently stored in the save memory
+u32 gbaHashSave(GbaSaveStream *stream, u32 ofs, u32 len) {
+  u8 buf[256];
+  u32 crc = 0;
+  gbaStreamSeek(stream, ofs);
+  while (len) {
+    u32 sublen = gbaStreamRead(stream, buf, min(len, sizeof(buf)));
+    if (!sublen) break;
+    crc = crc32Update(crc, buf, sublen);
+    len -= sublen;
+  }
+  return crc;
+}
+
+bool gbaVerifySave(u32 dst, u8 *src, u32 len, u8 type, int retries) {
+  if ((type < 3) || (type > 5)) return false;
+
+  GbaSaveStream stream;
+  gbaStreamOpen(&stream, type);
+  u32 end = min(dst + len, stream.size);
+  u32 ofs = dst;
+  while (ofs < end) {
+    // one 4k sector at a time; only the first may be unaligned
+    u32 sublen = min(end - ofs, 0x1000 - (ofs & 0xfff));
+    u8 *sector = src + (ofs - dst);
+    u32 expected = crc32(sector, sublen);
+    int attempt = 0;
+    while (gbaHashSave(&stream, ofs, sublen) != expected) {
+      if (attempt++ >= retries) return false;
+      // Write the sector again. Atmel chips erase each page on their own,
+      //  everyone else needs an erased sector (which also wipes whatever else
+      //  is in there, so we need to rewrite the entire sector).
+      if ((type != 3) && !gbaStreamIsAtmel(&stream)) {
+        if (sublen != 0x1000) return false;
+        gbaEraseSector(ofs, type);
+        stream.bank = -1;  // gbaEraseSector may have switched the bank
+      }
+      gbaStreamSeek(&stream, ofs);
+      gbaStreamWrite(&stream, sector, sublen);
+    }
+    ofs += sublen;
+  }
+  return true;
+}
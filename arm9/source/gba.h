@@ -66,8 +66,54 @@ uint8 gbaGetSaveType();
 uint32 gbaGetSaveSize(uint8 type = 255);
 uint32 gbaGetSaveSizeLog2(uint8 type = 255);
 
+// All accesses to GBA save memory go through a backend. On real hardware,
+//  this is the Slot-2 bus (save memory mapped at 0x0A000000); a simulator for
+//  host-side testing is found in arm9/host/gba_sim.h/.cpp (not part of the
+//  ROM). Offsets are relative to the start of the save memory window.
+// NOTE: the save type detection still scans the ROM directly, so when using the
+//  simulator, pass the save type explicitly.
+struct GbaSaveBackend {
+  u8 (*read8)(u32 ofs);
+  void (*write8)(u32 ofs, u8 val);
+  void (*delay)(u32 count);  // same units as swiDelay
+  void (*eepromRead8)(u8 *out, u32 block, bool short_addr);
+  void (*eepromWrite8)(const u8 *in, u32 block, bool short_addr);
+};
+
+extern const GbaSaveBackend gbaSlot2Backend;
+
+// Passing NULL selects the real Slot-2 bus again.
+void gbaSetBackend(const GbaSaveBackend *backend);
+const GbaSaveBackend *gbaGetBackend();
+
+// A streaming cursor into the save memory of a GBA game. On 128k Flash chips,
+//  the currently selected bank is remembered, so the bank switch sequence is
+//  only sent when an access actually crosses the 64k boundary. This allows
+//  callers to do many small reads or writes without paying for the bank switch
+//  every time.
+struct GbaSaveStream {
+  u8 type;
+  u32 pos;
+  u32 size;
+  s8 bank;   // currently selected Flash bank, -1 if unknown
+  s8 atmel;  // Atmel chips write 128 byte pages, -1 if not probed yet
+};
+
+void gbaStreamOpen(GbaSaveStream *stream, u8 type);
+bool gbaStreamSeek(GbaSaveStream *stream, u32 pos);
+u32 gbaStreamRead(GbaSaveStream *stream, u8 *dst, u32 len);
+// Flash memory must have been erased before writing to it!
+u32 gbaStreamWrite(GbaSaveStream *stream, const u8 *src, u32 len);
+
 bool gbaReadSave(u8 *dst, u32 src, u32 len, u8 type);
 bool gbaWriteSave(u32 dst, u8 *src, u32 len, u8 type);
 bool gbaFormatSave(u8 type);
+// Erases the 4k Flash sector containing "ofs" (type 4/5 only).
+bool gbaEraseSector(u32 ofs, u8 type);
+
+// Re-reads what has just been written and compares a CRC32 of each 4k sector
+//  against the intended data. Sectors that do not match are written again, up
+//  to "retries" times. Returns false if the save could not be verified.
+bool gbaVerifySave(u32 dst, u8 *src, u32 len, u8 type, int retries = 2);
 
 #endif  // __SLOT2_H__
@@ -29,6 +29,7 @@ u8 *data;
 u32 size_buf;
 
 auxspi_extra slot_1_type = AUXSPI_FLASH_CARD;
+SaveChipInfo slot_1_chip = {AUXSPI_FLASH_CARD, 0, 0, 0, 0, false, 0, 0, false};
 
 char ftp_ip[16] = "ftp_ip";
 char ftp_user[64] = "ftp_user";
@@ -38,6 +39,17 @@ bool ftp_active = false;
 
 int ir_delay = 1200;
 
+bool gba_snapshot = true;
+int snapshot_keep = 8;
+
+bool backup_store = true;
+
+int dldi_max_write = 0;
+bool backup_timing = false;
+
+int nor_verify = NOR_VERIFY_FULL;
+bool psram_staging = true;
+
 char device[16] = "/";
 
 char txt[256] = "";
@@ -48,6 +60,3 @@ u32 ezflash = 0;
 int slot2 = -1;
 
 bool sdslot = false;
-
-u32 extra_id[EXTRA_ARRAY_SIZE];
-u8 extra_size[EXTRA_ARRAY_SIZE];
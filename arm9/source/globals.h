@@ -44,6 +44,7 @@ extern u8 *data;
 extern u32 size_buf;
 
 extern auxspi_extra slot_1_type;
+extern SaveChipInfo slot_1_chip;
 
 extern char ftp_ip[16];
 extern char ftp_user[64];
@@ -53,6 +54,27 @@ extern bool ftp_active;
 
 extern int ir_delay;
 
+// automatic snapshots of GBA saves before they are modified
+extern bool gba_snapshot;
+extern int snapshot_keep;
+
+// new GBA backups go to the deduplicating backup store (savestore.h)
+extern bool backup_store;
+
+// biggest block written to the memory card at once (0: as the driver likes it)
+extern int dldi_max_write;
+// report the speed of backups (in KB/s)
+extern bool backup_timing;
+
+// how saves staged in the NOR of a 3in1 are checked: 0 = not at all,
+//  1 = one 4 kB piece of every block, 2 = everything
+#define NOR_VERIFY_NONE 0
+#define NOR_VERIFY_SAMPLED 1
+#define NOR_VERIFY_FULL 2
+extern int nor_verify;
+// stage restores in the PSRAM of the 3in1 instead of its NOR
+extern bool psram_staging;
+
 // all libfat access will be using this device. default value = "/", i.e.
 // "default" DLDI device
 extern char device[16];
@@ -67,10 +89,4 @@ extern int slot2;
 
 extern bool sdslot;
 
-// this should be enough for the forseeable future
-#define EXTRA_ARRAY_SIZE 16
-
-extern u32 extra_id[EXTRA_ARRAY_SIZE];
-extern u8 extra_size[EXTRA_ARRAY_SIZE];
-
 #endif  // GLOBALS_H
\ No newline at end of file
@@ -26,6 +26,8 @@
 
 #include "hardware.h"
 
+#include <ctype.h>
+#include <dirent.h>
 #include <dswifi9.h>
 #include <fat.h>
 #include <nds.h>
@@ -33,13 +35,17 @@
 #include <nds/arm9/dldi.h>
 #include <nds/card.h>
 #include <nds/interrupts.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <sys/dir.h>
+#include <sys/stat.h>
 #include <sys/unistd.h>
+#include <time.h>
 
 #include <algorithm>
 
 #include "auxspi.h"
+#include "crc32.h"
 #include "display.h"
 #include "dsCard.h"
 #include "fileselect.h"
@@ -48,6 +54,7 @@
 #include "globals.h"
 #include "languages.h"
 #include "poke.h"
+#include "savestore.h"
 #include "strings.h"
 #include "supported_games.h"
 
@@ -91,24 +98,248 @@ bool game_header_looks_okay(sNDSHeader *header) {
   return true;
 }
 
-void find_unused_filename(const char *gamename, const char *path, char *fname) {
-  char fullpath[256];
+// ---------------------------------------------------------------------
+// Buffered writing of backups: data read from the game is collected in a
+//  staging buffer, and written to the card in big, sector aligned blocks.
+//  This is a lot faster than many small "fwrite" calls, since the FAT code has
+//  to do its bookkeeping only once per block.
+#define WRITER_ALIGN 0x200
+
+// Some DLDI drivers fail on big writes. These get small writes instead.
+static const struct {
+  const char *name;
+  u32 max_write;
+} dldi_write_limits[] = {
+    {"GBA Movie Player", 0x100},
+    {"M3 Adapter", 0x100},
+    {"SuperCard (", 0x100},
+};
+
+struct BackupWriter {
+  FILE *file;
+  u8 *buf;
+  u32 cap;
+  u32 fill;
+  u32 total;
+  u32 max_write;
+  bool ok;
+};
+
+// local function
+u32 hwMaxWrite() {
+  if (dldi_max_write > 0) return dldi_max_write;
+  for (u32 i = 0; i < sizeof(dldi_write_limits) / sizeof(dldi_write_limits[0]);
+       i++) {
+    const char *name = dldi_write_limits[i].name;
+    if (!strncasecmp(io_dldi_data->friendlyName, name, strlen(name)))
+      return dldi_write_limits[i].max_write;
+  }
+  return 0;  // no limit
+}
+
+// local function: "buf" should be as big as possible, but at least as big as
+//  the biggest block passed to hwWriterReserve().
+void hwWriterOpen(BackupWriter *w, FILE *file, u8 *buf, u32 cap) {
+  w->file = file;
+  w->buf = buf;
+  w->cap = cap & ~(WRITER_ALIGN - 1);
+  w->fill = 0;
+  w->total = 0;
+  w->max_write = hwMaxWrite();
+  w->ok = (file != NULL);
+  if (backup_timing) cpuStartTiming(0);
+}
+
+// local function
+void hwWriterFlush(BackupWriter *w) {
+  u32 step = w->max_write ? w->max_write : w->fill;
+  for (u32 ofs = 0; w->ok && (ofs < w->fill); ofs += step) {
+    u32 len = min(step, w->fill - ofs);
+    if (fwrite(w->buf + ofs, 1, len, w->file) != len) w->ok = false;
+  }
+  w->total += w->fill;
+  w->fill = 0;
+}
+
+// local function: returns where the next "len" bytes should be read to
+u8 *hwWriterReserve(BackupWriter *w, u32 len) {
+  if (w->fill + len > w->cap) hwWriterFlush(w);
+  return w->buf + w->fill;
+}
+
+// local function
+void hwWriterCommit(BackupWriter *w, u32 len) { w->fill += len; }
+
+// local function: returns false if anything could not be written
+bool hwWriterClose(BackupWriter *w) {
+  hwWriterFlush(w);
+  if (w->file) fclose(w->file);
+  if (backup_timing) {
+    // timer ticks at BUS_CLOCK (33.5 MHz)
+    u32 ticks = max(cpuEndTiming(), (u32)1);
+    sprintf(txt, "%lu KB/s", (u32)((u64)w->total * BUS_CLOCK / 1024 / ticks));
+    displayStateF(STR_STR, txt);
+  }
+  return w->ok;
+}
+
+// Finds the next free "gamename.N.ext". All backups of a game share one
+//  counter (whatever their extension is), and it is found by reading the
+//  folder only once instead of testing every N.
+void find_unused_filename(const char *gamename, const char *path, char *fname,
+                          const char *ext = "sav") {
   uint32 cnt = 0;
+  sprintf(fname, "%s.%lu.%s", gamename, cnt, ext);
+  displayMessage2F(STR_HW_SEEK_UNUSED_FNAME, fname);
+
+  int len = strlen(gamename);
+  DIR *pdir = opendir(path);
+  if (pdir) {
+    struct dirent *ent;
+    while ((ent = readdir(pdir)) != NULL) {
+      if (strncmp(ent->d_name, gamename, len) || (ent->d_name[len] != '.'))
+        continue;
+      char *end;
+      uint32 n = strtoul(ent->d_name + len + 1, &end, 10);
+      if ((end != ent->d_name + len + 1) && (*end == '.') && (n >= cnt))
+        cnt = n + 1;
+    }
+    closedir(pdir);
+  }
+
+  if (cnt > 65536) {
+    displayWarning2F(STR_ERR_NO_FNAME);
+    while (1)
+      ;
+  }
+  sprintf(fname, "%s.%lu.%s", gamename, cnt, ext);
+}
 
-  sprintf(fname, "%s.%lu.sav", gamename, cnt);
+// ---------------------------------------------------------------------
+// Every folder with Slot 1 backups keeps a list of their CRC32 and size, so a
+//  save that is already backed up there does not have to be written again.
+//  The list only names candidates: a backup is compared byte by byte before
+//  it is taken for the save.
+#define HASH_LIST ".hashes"
+
+// local function: true if the file "fullpath" holds exactly "size" bytes of
+//  "buf"
+bool hwSameFile(const char *fullpath, const u8 *buf, u32 size) {
+  FILE *file = fopen(fullpath, "rb");
+  if (!file) return false;
+  u8 chunk[0x200];
+  u32 ofs = 0;
+  while (ofs < size) {
+    u32 len = min(size - ofs, (u32)sizeof(chunk));
+    if ((fread(chunk, 1, len, file) != len) || memcmp(chunk, buf + ofs, len))
+      break;
+    ofs += len;
+  }
+  bool same = (ofs == size) && (fgetc(file) == EOF);
+  fclose(file);
+  return same;
+}
+
+// local function: finds a backup in "path" that holds the "size" bytes of
+//  "save" (with this CRC), and copies its name to "match". If "only" is given,
+//  no other file counts.
+bool hwHashLookup(const char *path, const u8 *save, u32 crc, u32 size,
+                  const char *only, char *match) {
+  char fullpath[256];
+  char line[300];
+  sprintf(fullpath, "%s/%s", path, HASH_LIST);
+  FILE *list = fopen(fullpath, "r");
+  if (!list) return false;
+
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), list)) {
+    unsigned long c, s;
+    int ofs = 0;
+    if (sscanf(line, "%lx %lu %n", &c, &s, &ofs) < 2) continue;
+    char *name = line + ofs;
+    name[strcspn(name, "\r\n")] = 0;
+    if ((c != crc) || (s != size) || !name[0]) continue;
+    if (only && strcmp(name, only)) continue;
+    // the file may have been deleted or changed since
+    sprintf(fullpath, "%s/%s", path, name);
+    if (!hwSameFile(fullpath, save, size)) continue;
+    strcpy(match, name);
+    found = true;
+  }
+  fclose(list);
+  return found;
+}
+
+// local function: adds a backup to the list in "path", replacing an older
+//  entry of the same file
+void hwHashRecord(const char *path, const char *fname, u32 crc, u32 size) {
+  char listpath[256];
+  char tmppath[256];
+  char line[300];
+  sprintf(listpath, "%s/%s", path, HASH_LIST);
+  sprintf(tmppath, "%s.tmp", listpath);
+  FILE *out = fopen(tmppath, "w");
+  if (!out) return;
+
+  FILE *in = fopen(listpath, "r");
+  if (in) {
+    while (fgets(line, sizeof(line), in)) {
+      unsigned long c, s;
+      int ofs = 0;
+      if (sscanf(line, "%lx %lu %n", &c, &s, &ofs) < 2) continue;
+      char *name = line + ofs;
+      name[strcspn(name, "\r\n")] = 0;
+      if (name[0] && strcmp(name, fname))
+        fprintf(out, "%08lx %lu %s\n", c, s, name);
+    }
+    fclose(in);
+  }
+  fprintf(out, "%08lx %lu %s\n", crc, size, fname);
+  fclose(out);
+
+  remove(listpath);
+  rename(tmppath, listpath);
+}
+
+// local function: backs up the save of the game in Slot 1 to "path/fname".
+//  Saves that fit the buffer are read completely before anything is written,
+//  and are not written at all if an identical backup exists: "chosen" is set
+//  if the user picked "fname", in which case only that file counts.
+void hwBackupSlot1(const char *path, const char *fname, bool chosen) {
+  char fullpath[256];
   sprintf(fullpath, "%s/%s", path, fname);
-  displayMessage2F(STR_HW_SEEK_UNUSED_FNAME, fname);
-  while (fileExists(fullpath)) {
-    if (cnt < 65536) {
-      cnt++;
-    } else {
-      displayWarning2F(STR_ERR_NO_FNAME);
-      while (1)
-        ;
+  displayMessage2F(STR_HW_WRITE_FILE, fullpath);
+
+  u32 total = 1 << slot_1_chip.size_log2;
+  u32 LEN = min(total, (u32)0x10000);
+  u32 size_blocks = total / LEN;
+  bool buffered = (total <= size_buf);
+
+  BackupWriter writer;
+  if (!buffered) hwWriterOpen(&writer, fopen(fullpath, "wb"), data, size_buf);
+  u32 crc = 0;
+  for (u32 i = 0; i < size_blocks; i++) {
+    displayProgressBar(i + 1, size_blocks);
+    u8 *dst = buffered ? data + i * LEN : hwWriterReserve(&writer, LEN);
+    auxspi_read_data(i * LEN, dst, LEN, &slot_1_chip);
+    crc = crc32Update(crc, dst, LEN);
+    if (!buffered) hwWriterCommit(&writer, LEN);
+  }
+
+  if (buffered) {
+    char match[256];
+    if (hwHashLookup(path, data, crc, total, chosen ? fname : NULL, match)) {
+      displayMessage2F(STR_HW_ALREADY_BACKED_UP, match, crc);
+      return;
     }
-    sprintf(fname, "%s.%lu.sav", gamename, cnt);
-    sprintf(fullpath, "%s/%s", path, fname);
+    // the save is already in the buffer of the writer
+    hwWriterOpen(&writer, fopen(fullpath, "wb"), data, size_buf);
+    hwWriterCommit(&writer, total);
   }
+  if (hwWriterClose(&writer))
+    hwHashRecord(path, fname, crc, total);
+  else
+    displayWarning2F(STR_HW_BACKUP_WRITE_FAILED);
 }
 
 // ---------------------------------------------------------------------
@@ -130,7 +361,7 @@ bool swap_cart(bool allow_cancel) {
       uint32 keys = keysDown();
       if (keys & KEY_A) {
         // identify hardware
-        slot_1_type = auxspi_has_extra();
+        slot_1_type = auxspi_has_extra(&slot_1_chip);
         // don't try to dump a flash card
         if (slot_1_type == AUXSPI_FLASH_CARD) continue;
 
@@ -138,6 +369,9 @@ bool swap_cart(bool allow_cancel) {
         // this will break DLDI on the Cyclops Evolution, but we need it anyway.
         cardReadHeader((u8 *)&nds);
         displayPrintUpper();
+#ifdef DEBUG
+        auxspi_benchmark(&slot_1_chip);
+#endif
         if (!game_header_looks_okay(&nds)) {
           displayMessage2F(STR_HW_CARD_UNREADABLE);
           continue;
@@ -208,7 +442,7 @@ bool hwDetectSlot2DLDI() {
 // selects the mode.
 u32 hwDetect() {
   // Identify Slot 1 device. This is used by pretty much everything.
-  slot_1_type = auxspi_has_extra();
+  slot_1_type = auxspi_has_extra(&slot_1_chip);
 
   // First, look for a DSi running in DSi mode.
   if (isDSiMode()) {
@@ -235,13 +469,11 @@ u32 hwDetect() {
   //
   // ... HOWEVER: We are also using a Slot 2 ini parameter, so WiFi mode can
   // also be
-  //  accessed from Slot 2 (if you need it).
+  //  accessed from Slot 2 (if you need it). The ini file is loaded before, so
+  //  the parameter (if present) is not overwritten here.
   //
-  if (hwDetectSlot2DLDI()) {
-    slot2 = 1;
-    return 4;
-  } else
-    slot2 = 0;
+  if (slot2 < 0) slot2 = hwDetectSlot2DLDI() ? 1 : 0;
+  if (slot2 > 0) return 4;
 
   // Look for an EZFlash 3in1
   uint32 ime = enterCriticalSection();
@@ -262,7 +494,8 @@ u32 hwDetect() {
   // does not work
   //  from flash cards or download play, but it may still result in a positive
   //  DLDI driver initialisation. So we can't simply run "fatInitDefault" and
-  //  test return values.
+  //  test return values. (It has already run when the ini file was loaded,
+  //  and its result must not be used here either.)
   // - Currently, download play mode aims to "insert game first, then run dlp",
   // i.e.
   //  it does not support hotswapping the game. So we select this mode if there
@@ -279,17 +512,400 @@ u32 hwDetect() {
 }
 
 // --------------------------------------------------------
+// --------------------------------------------------------
+// Saves are staged in the NOR of the 3in1 in blocks of 32 kB. Instead of
+//  reading a block back into a second buffer, the CRC32 of what was written
+//  is compared with the CRC32 of the NOR window ("nor_verify").
+#define NOR_BLOCK 0x8000
+#define NOR_SAMPLE 0x1000
+
+// The header block of the NOR (the first 256 kB) keeps a marker at 0x2000 of
+//  the 256 kB blocks that are known to be blank, so they don't need to be
+//  erased (or even checked) next time. NOR bits can only be cleared without
+//  an erase, so a block's bit is cleared on the NOR before anything is staged
+//  in it (a session that is interrupted leaves a marker that is still true),
+//  and the marker is only set up again whenever the header block is erased.
+#define NOR_MARKER 0x2000
+#define NOR_MARKER_MAGIC 0x4b4e4c42  // "BLNK"
+struct NorMarker {
+  u32 magic;
+  u32 reserved;
+  u64 blank;  // bit i: block i is blank (block 0 is never)
+};
+static u64 nor_blank = 0;
+
+// local function: the 3in1 has to be grabbed
+void hwNorLoadMarker() {
+  NorMarker marker;
+  ReadNorFlash((u8 *)&marker, NOR_MARKER, sizeof(marker));
+  nor_blank = (marker.magic == NOR_MARKER_MAGIC) ? marker.blank : 0;
+}
+
+// local function: the marker that can be programmed over the one in the NOR,
+//  i.e. without setting any bit; the 3in1 has to be grabbed
+void hwNorMarker(NorMarker *marker) {
+  ReadNorFlash((u8 *)marker, NOR_MARKER, sizeof(*marker));
+  if ((marker->magic == 0xffffffff) && (marker->reserved == 0xffffffff) &&
+      !~marker->blank) {
+    // erased along with the header block
+    marker->magic = NOR_MARKER_MAGIC;
+    marker->reserved = 0;
+    marker->blank = nor_blank;
+  } else if (marker->magic == NOR_MARKER_MAGIC) {
+    marker->blank &= nor_blank;
+  }
+}
+
+// local function: writes the first 32 kB of the header block, with the
+//  current marker; the 3in1 has to be grabbed. Returns false if the NOR
+//  reports an error.
+bool hwNorWriteHeader(u8 *buf) {
+  NorMarker marker;
+  hwNorMarker(&marker);
+  memcpy(buf + NOR_MARKER, &marker, sizeof(marker));
+  return WriteNorFlash(0, buf, NOR_BLOCK);
+}
+
+// local function: the NOR could not be written; releases the 3in1 and halts
+void hwNorFailed(uint32 ime) {
+  hwRelease3in1(ime);
+  displayMessage2F(STR_HW_3IN1_ERR_NOR);
+  while (1)
+    ;
+}
+
+// local function: clears the bit of the block at "address" in the marker in
+//  the NOR, before the block is written to; the 3in1 has to be grabbed
+bool hwNorUsed(u32 address) {
+  u32 block = address >> 18;
+  if ((block >= 64) || !(nor_blank & ((u64)1 << block))) return true;
+  nor_blank &= ~((u64)1 << block);
+  NorMarker marker;
+  ReadNorFlash((u8 *)&marker, NOR_MARKER, sizeof(marker));
+  if ((marker.magic != NOR_MARKER_MAGIC) ||
+      !(marker.blank & ((u64)1 << block)))
+    return true;
+  marker.blank &= nor_blank;
+  return WriteNorWords(NOR_MARKER + offsetof(NorMarker, blank),
+                       (const u16 *)&marker.blank, sizeof(marker.blank) / 2);
+}
+
+// local function: writes block "i" of the staged save and checks it; halts
+//  if the NOR does not work. An error reported by the chips always halts,
+//  whatever "nor_verify" says.
+void hwWriteNorBlock(u32 i, u8 *buf, u32 len) {
+  uint32 ime = hwGrab3in1();
+  SetSerialMode();
+  if (!hwNorUsed(i * NOR_BLOCK + pitch)) hwNorFailed(ime);
+  if (!WriteNorFlash(i * NOR_BLOCK + pitch, buf, len)) hwNorFailed(ime);
+  hwRelease3in1(ime);
+  if (GetNorBus()->read16(FlashBase + 0x2002) == 0x227E) {
+    displayMessage2F(STR_HW_3IN1_ERR_IDMODE);
+    while (1)
+      ;
+  }
+  if (nor_verify == NOR_VERIFY_NONE) return;
+
+  // a sample is taken from a different place in every block
+  u32 ofs = 0;
+  if ((nor_verify == NOR_VERIFY_SAMPLED) && (len > NOR_SAMPLE)) {
+    ofs = (i * NOR_SAMPLE) % len;
+    len = NOR_SAMPLE;
+  }
+  ime = hwGrab3in1();
+  u32 crc = Crc32NorFlash(0, i * NOR_BLOCK + pitch + ofs, len);
+  hwRelease3in1(ime);
+  if (crc != crc32(buf + ofs, len)) {
+    displayMessage2F(STR_HW_3IN1_ERR_NOR);
+    while (1)
+      ;
+  }
+}
+
+// local function
+void hwReportNorSpeed(u32 total) {
+  if (!backup_timing) return;
+  static const char *mode[] = {"none", "sampled", "full"};
+  u32 ticks = max(cpuEndTiming(), (u32)1);
+  sprintf(txt, "NOR (verify: %s): %lu KB/s", mode[nor_verify],
+          (u32)((u64)total * BUS_CLOCK / 1024 / ticks));
+  displayStateF(STR_STR, txt);
+}
+
+// Dumps keep the NOR mapped and copy it by DMA into one half of "data", while
+//  the other half is written to the card. NOR_STREAM is the most that is read
+//  ahead, so the first block (which can't overlap with a write) stays short.
+#define NOR_DMA 1
+#define NOR_STREAM 0x40000
+
+// local function: "buf" must not be touched until hwNorDmaWait()
+void hwNorDmaStart(u8 *buf, u32 address, u32 len) {
+  OpenNorRead(address);
+  // dirty cache lines must not be written back over the new data later
+  DC_FlushRange(buf, len);
+  const u8 *src = GetNorBus()->window(FlashBase + address, len);
+  dmaCopyWordsAsynch(NOR_DMA, src, buf, len);
+}
+
+// local function
+void hwNorDmaWait(u8 *buf, u32 len) {
+  while (dmaBusy(NOR_DMA))
+    ;
+  DC_InvalidateRange(buf, len);
+}
+
+// --------------------------------------------------------
+// Restores don't have to survive a reboot, so they can be staged in the PSRAM
+//  of the 3in1 instead ("psram_staging"): no erase, no programming and no wear
+//  of the NOR. A small header with the CRC32 of the save makes sure that an
+//  old or damaged image is never written to a game.
+#define PSRAM_BASE ((u8 *)FlashBase)
+#define PSRAM_DATA 0x1000
+#define PSRAM_MAGIC 0x53505347  // "GSPS"
+struct PsramHeader {
+  u32 magic;
+  u32 size;
+  u32 crc;
+  u32 reserved;
+};
+
+// local function
+bool hwSourcePsram(u32 ofs, u8 *buf, u32 len, void *ctx) {
+  uint32 ime = hwGrab3in1();
+  ReadPSram(PSRAM_BASE + PSRAM_DATA + ofs, buf, len);
+  hwRelease3in1(ime);
+  return true;
+}
+
+// local function: true if the PSRAM holds a complete save of "size" bytes;
+//  uses "data" as a buffer
+bool hwPsramValid(u32 size) {
+  PsramHeader header;
+  uint32 ime = hwGrab3in1();
+  ReadPSram(PSRAM_BASE, (u8 *)&header, sizeof(header));
+  hwRelease3in1(ime);
+  if ((header.magic != PSRAM_MAGIC) || (header.size != size)) return false;
+
+  u32 crc = 0;
+  for (u32 ofs = 0; ofs < size; ofs += NOR_BLOCK) {
+    u32 len = min(size - ofs, (u32)NOR_BLOCK);
+    hwSourcePsram(ofs, data, len, NULL);
+    crc = crc32Update(crc, data, len);
+  }
+  return crc == header.crc;
+}
+
+// local function: copies "size" bytes of "file" to the PSRAM; returns false
+//  if they don't read back correctly
+bool hwStagePsram(FILE *file, u32 size) {
+  PsramHeader header = {0, size, 0, 0};
+  // the old image is invalid from now on
+  uint32 ime = hwGrab3in1();
+  WritePSram(PSRAM_BASE, (u8 *)&header, sizeof(header));
+  hwRelease3in1(ime);
+
+  if (backup_timing) cpuStartTiming(0);
+  for (u32 ofs = 0; ofs < size; ofs += NOR_BLOCK) {
+    u32 len = min(size - ofs, (u32)NOR_BLOCK);
+    displayProgressBar(ofs / NOR_BLOCK, size / NOR_BLOCK);
+    u32 in = fread(data, 1, len, file);
+    if (in < len) memset(data + in, 0xff, len - in);
+    header.crc = crc32Update(header.crc, data, len);
+    ime = hwGrab3in1();
+    WritePSram(PSRAM_BASE + PSRAM_DATA + ofs, data, len);
+    hwRelease3in1(ime);
+  }
+
+  header.magic = PSRAM_MAGIC;
+  ime = hwGrab3in1();
+  WritePSram(PSRAM_BASE, (u8 *)&header, sizeof(header));
+  hwRelease3in1(ime);
+  bool ok = hwPsramValid(size);
+  if (backup_timing) {
+    u32 ticks = max(cpuEndTiming(), (u32)1);
+    sprintf(txt, "PSRAM: %lu KB/s",
+            (u32)((u64)size * BUS_CLOCK / 1024 / ticks));
+    displayStateF(STR_STR, txt);
+  }
+  return ok;
+}
+
+// Blocks that are blank already (by the marker, or by reading them) are not
+//  erased again. Formatting the header block uses "data" as a buffer.
 void hwFormatNor(uint32 page, uint32 count) {
   uint32 ime = hwGrab3in1();
   SetSerialMode();
+  hwNorLoadMarker();
   displayProgressBar(0, count);
   for (uint32 i = page; i < page + count; i++) {
-    Block_Erase(i << 18);
+    bool known = (i > 0) && (i < 64) && (nor_blank & ((u64)1 << i));
+    if (!known && !IsBlankNorFlash(i << 18, 1 << 18)) Block_Erase(i << 18);
+    if ((i > 0) && (i < 64)) nor_blank |= (u64)1 << i;
     displayProgressBar(i + 1 - page, count);
   }
+  // the marker is gone with the header
+  if (page == 0) {
+    memset(data, 0xff, NOR_BLOCK);
+    if (!hwNorWriteHeader(data)) hwNorFailed(ime);
+  }
   hwRelease3in1(ime);
 }
 
+// --------------------------------------------------------
+// Differential restore of a Slot 1 save: the save is compared with the chip in
+//  blocks of 64 kB (the erase sector of Flash chips), and only what differs is
+//  written. On Flash chips, a sector is only erased if some bit has to go from
+//  0 to 1; after an erase, pages that are blank (0xff) are skipped.
+#define RESTORE_BLOCK 0x10000
+
+// The source of a restore: fills "buf" with "len" bytes at offset "ofs" of the
+//  save. Blocks are requested in order.
+typedef bool (*hwRestoreSource)(u32 ofs, u8 *buf, u32 len, void *ctx);
+
+typedef enum {
+  RESTORE_OK,
+  RESTORE_NOT_STARTED,    // unknown chip, or "data" too small: nothing written
+  RESTORE_SOURCE_FAILED,  // the game may be partly written
+  RESTORE_VERIFY_FAILED
+} restore_result;
+
+// local function: the message for a restore that failed
+int hwRestoreError(restore_result result) {
+  switch (result) {
+    case RESTORE_NOT_STARTED:
+      return STR_HW_RESTORE_NOT_STARTED;
+    case RESTORE_SOURCE_FAILED:
+      return STR_HW_RESTORE_READ_FAILED;
+    default:
+      return STR_HW_VERIFY_FAILED;
+  }
+}
+
+// local function
+bool hwSourceFile(u32 ofs, u8 *buf, u32 len, void *ctx) {
+  u32 in = fread(buf, 1, len, (FILE *)ctx);
+  if (ferror((FILE *)ctx)) return false;
+  // a short file is padded, just like an erased chip
+  if (in < len) memset(buf + in, 0xff, len - in);
+  return true;
+}
+
+// local function: the chips are reset once by hwRestore3in1_b, so every piece
+//  only needs the NOR mapped, which is cheap enough for the prefetch
+bool hwSourceNor(u32 ofs, u8 *buf, u32 len, void *ctx) {
+  OpenNorRead(ofs + pitch);
+  memcpy(buf, GetNorBus()->window(FlashBase + ofs + pitch, len), len);
+  return true;
+}
+
+// local function
+bool hwIsBlank(const u8 *buf, u32 len) {
+  const u32 *buf4 = (const u32 *)buf;
+  for (u32 i = 0; i < (len >> 2); i++)
+    if (buf4[i] != 0xffffffff) return false;
+  return true;
+}
+
+// The next block is read from the source while the chip is busy with the
+//  current one, in pieces small enough to fit in the time a page takes to
+//  program. So a restore takes about as long as the slower of both, instead of
+//  their sum.
+#define RESTORE_PIECE 0x1000
+
+struct RestorePrefetch {
+  hwRestoreSource source;
+  void *ctx;
+  u8 *buf;
+  u32 ofs;
+  u32 len;
+  u32 done;
+  bool ok;
+};
+
+// local function: reads the next piece, returns false if there is none
+bool hwPrefetchStep(RestorePrefetch *pf) {
+  if (pf->done >= pf->len) return false;
+  u32 sublen = min(pf->len - pf->done, (u32)RESTORE_PIECE);
+  if (!pf->source(pf->ofs + pf->done, pf->buf + pf->done, sublen, pf->ctx))
+    pf->ok = false;
+  pf->done += sublen;
+  // the source may have used the bus (e.g. DLDI or the 3in1)
+  sysSetBusOwners(true, true);
+  return true;
+}
+
+// local function: waits for the chip, and keeps prefetching meanwhile
+void hwRestoreWait(const SaveChipInfo *chip, RestorePrefetch *pf) {
+  while (auxspi_busy(chip)) {
+    if (!hwPrefetchStep(pf)) {
+      auxspi_wait(chip);
+      break;
+    }
+  }
+}
+
+// local function
+restore_result hwRestoreSlot1(hwRestoreSource source, void *ctx) {
+  const SaveChipInfo *chip = &slot_1_chip;
+  u32 page = chip->page;
+  if (!chip->type || !page) return RESTORE_NOT_STARTED;
+  u32 size = 1 << chip->size_log2;
+  u32 block = min(size, (u32)RESTORE_BLOCK);
+  if (size_buf < 3 * RESTORE_BLOCK) return RESTORE_NOT_STARTED;
+  // two staging buffers for the source, one for the chip contents
+  u8 *stage[2] = {data, data + RESTORE_BLOCK};
+  u8 *have = data + 2 * RESTORE_BLOCK;
+
+  RestorePrefetch pf = {source, ctx, stage[0], 0, block, 0, true};
+  u32 num_blocks = size / block;
+  for (u32 ofs = 0, n = 0; ofs < size; ofs += block, n++) {
+    displayProgressBar(n + 1, num_blocks);
+    // whatever is left of this block (all of it, for the first one)
+    while (hwPrefetchStep(&pf))
+      ;
+    if (!pf.ok) return RESTORE_SOURCE_FAILED;
+    u8 *want = pf.buf;
+
+    // start on the next block
+    pf.buf = stage[(n + 1) & 1];
+    pf.ofs = ofs + block;
+    pf.len = (ofs + block < size) ? block : 0;
+    pf.done = 0;
+
+    sysSetBusOwners(true, true);
+    auxspi_read_data(ofs, have, block, chip);
+    if (!memcmp(want, have, block)) continue;
+
+    // Flash can only clear bits, anything else needs an erase
+    bool erase = false;
+    if (chip->type == 3) {
+      for (u32 i = 0; i < block; i++) {
+        if (want[i] & ~have[i]) {
+          erase = true;
+          break;
+        }
+      }
+    }
+    if (erase) {
+      auxspi_erase_sector(ofs >> 16, chip, false);
+      hwRestoreWait(chip, &pf);
+    }
+
+    for (u32 p = 0; p < block; p += page) {
+      if (erase ? hwIsBlank(want + p, page) : !memcmp(want + p, have + p, page))
+        continue;
+      auxspi_write_data(ofs + p, want + p, page, chip, false);
+      hwRestoreWait(chip, &pf);
+    }
+
+    // the block has to read back as it was sent
+    sysSetBusOwners(true, true);
+    auxspi_read_data(ofs, have, block, chip);
+    if (memcmp(want, have, block)) return RESTORE_VERIFY_FAILED;
+  }
+  return RESTORE_OK;
+}
+
 // --------------------------------------------------------
 // uncomment this to enable slot 1 operations... but implement
 // "dsiUnlockSlot1()" before! the following two functions are *untested* and may
@@ -308,12 +924,6 @@ void hwBackupDSi() {
   displayPrintUpper();
 #endif
 
-  uint8 size = auxspi_save_size_log_2(slot_1_type);
-  int size_blocks =
-      1 << max(0, (int8(size) -
-                   18));  // ... in units of 0x40000 bytes - that's 256 kB
-  uint8 type = auxspi_save_type(slot_1_type);
-
   // select target filename
   displayMessageF(STR_HW_SELECT_FILE_OW);
 
@@ -321,26 +931,13 @@ void hwBackupDSi() {
   char fname[256] = "";
   fileSelect("sd:/", path, fname, 0, true, false);
 
-  if (!fname[0]) {
+  bool chosen = (fname[0] != 0);
+  if (!chosen) {
     find_unused_filename((char *)0x080000a0, path, fname);
   }
-  char fullpath[256];
-  sprintf(fullpath, "%s/%s", path, fname);
-  displayMessage2F(STR_HW_WRITE_FILE, fullpath);
 
   // backup the file
-  FILE *file = fopen(fullpath, "wb");
-  if (size < 16)
-    size_blocks = 1;
-  else
-    size_blocks = 1 << (size - 16);
-  u32 LEN = min(1 << size, 1 << 16);
-  for (int i = 0; i < size_blocks; i++) {
-    displayProgressBar(i + 1, size_blocks);
-    auxspi_read_data(i << 8, data, LEN, type, slot_1_type);
-    fwrite(data, 1, LEN, file);
-  }
-  fclose(file);
+  hwBackupSlot1(path, fname, chosen);
 
   displayProgressBar(0, 0);
   displayMessageF(STR_EMPTY);
@@ -358,39 +955,11 @@ void hwRestoreDSi() {
   displayPrintUpper();
 #endif
 
-  uint8 size = auxspi_save_size_log_2(slot_1_type);
-  uint8 type = auxspi_save_type(slot_1_type);
-
   // select source filename
   char path[256];
   char fname[256] = "";
   fileSelect("sd:/", path, fname, 0, true, false);
 
-  // format game if required
-  if (type == 3) {
-    displayMessage2F(STR_HW_FORMAT_GAME);
-    auxspi_erase(slot_1_type);
-  }
-
-  // and finally, write save
-  displayMessage2F(STR_HW_WRITE_GAME);
-  u32 LEN = 0, num_blocks = 0, shift = 0;
-  switch (type) {
-    case 1:
-      shift = 4;  // 16 bytes
-      break;
-    case 2:
-      shift = 5;  // 32 bytes
-      break;
-    case 3:
-      shift = 8;  // 256 bytes
-      break;
-    default:
-      return;
-  }
-  LEN = 1 << shift;
-  num_blocks = 1 << (size - shift);
-
   char msg[256];
   sprintf(msg, "%s/%s", path, fname);
   FILE *file = fopen(msg, "rb");
@@ -399,68 +968,120 @@ void hwRestoreDSi() {
     while (1)
       ;
   }
-  for (unsigned int i = 0; i < num_blocks; i++) {
-    if (i % (num_blocks >> 6) == 0) displayProgressBar(i + 1, num_blocks);
-    fread(data, 1, LEN, file);
-    sysSetBusOwners(true, true);
-    auxspi_write_data(i << shift, data, LEN, type, slot_1_type);
-  }
+
+  // and finally, write save (only what differs from the game)
+  displayMessage2F(STR_HW_WRITE_GAME);
+  restore_result result = hwRestoreSlot1(hwSourceFile, file);
   fclose(file);
+  if (result != RESTORE_OK) {
+    displayWarning2F(hwRestoreError(result));
+    return;
+  }
 
   displayProgressBar(0, 0);
   displayMessageF(STR_EMPTY);
 }
 
 // --------------------------------------------------------
-void hwBackup3in1() {
-  if (!swap_cart(true)) {
-    return;
+// --------------------------------------------------------
+// Several games can be backed up to the NOR before rebooting: their saves are
+//  staged one after another from "pitch" on, each starting on a fresh 256 kB
+//  block, and an index at 0x3000 of the header block tells the dump after the
+//  reboot where they are.
+#define NOR_INDEX 0x3000
+#define NOR_INDEX_MAGIC 0x58444e49  // "INDX"
+#define NOR_SLOTS 16
+// staging stops here, which fits every 3in1
+#define NOR_END 0x1000000
+
+struct NorSlot {
+  u32 seq;        // order of the backups, starting with 1
+  u32 offset;     // in the NOR
+  u32 size_log2;  // of the save
+  u32 crc;        // CRC32 of the save
+  char title[12];
+  char code[4];
+};
+
+struct NorIndex {
+  u32 magic;
+  u32 count;
+  NorSlot slot[NOR_SLOTS];
+};
+
+// local function: true for (A), false for (B)
+bool hwAskAnother() {
+  displayMessage2F(STR_HW_3IN1_ANOTHER);
+  while (1) {
+    swiWaitForVBlank();
+    scanKeys();
+    uint32 keys = keysDown();
+    if (keys & KEY_A) return true;
+    if (keys & KEY_B) return false;
   }
-  displayPrintUpper();
-
-  uint8 size = auxspi_save_size_log_2(slot_1_type);
-  int size_blocks =
-      1 << max(0, (int8(size) -
-                   18));  // ... in units of 0x40000 bytes - that's 256 kB
-  uint8 type = auxspi_save_type(slot_1_type);
-
-  displayMessage2F(STR_HW_3IN1_FORMAT_NOR);
-  hwFormatNor(0, size_blocks + 1);
+}
 
-  displayMessage2F(STR_HW_READ_GAME);
-  if (size < 15)
-    size_blocks = 1;
-  else
-    size_blocks = 1 << (uint8(size) - 15);
-  u8 *test = (u8 *)malloc(0x8000);
-  if (test == NULL)
-    while (1)
-      ;
-  u32 LEN = min(1 << size, 0x8000);
+void hwBackup3in1() {
+  NorIndex index;
+  memset(&index, 0, sizeof(index));
+  index.magic = NOR_INDEX_MAGIC;
+  u32 next = 0x40000;
 
-  for (int i = 0; i < size_blocks; i++) {
-    displayProgressBar(i + 1, size_blocks);
-    auxspi_read_data(i << 15, data, LEN, type, slot_1_type);
-    uint32 ime = hwGrab3in1();
-    SetSerialMode();
-    WriteNorFlash((i << 15) + pitch, data, LEN);
-    hwRelease3in1(ime);
-    // test if NOR memory is sane, i.e. if we can read what we just wrote
-    ime = hwGrab3in1();
-    ReadNorFlash(test, (i << 15) + pitch, LEN);
-    hwRelease3in1(ime);
-    if (*((vuint16 *)(FlashBase + 0x2002)) == 0x227E) {
-      displayMessage2F(STR_HW_3IN1_ERR_IDMODE);
-      while (1)
-        ;
+  while (1) {
+    if (!swap_cart(true)) {
+      if (!index.count) return;
+      break;
     }
-    if (memcmp(test, data, LEN)) {
-      displayMessage2F(STR_HW_3IN1_ERR_NOR);
-      while (1)
-        ;
+    displayPrintUpper();
+
+    uint8 size = slot_1_chip.size_log2;
+    int size_blocks =
+        1 << max(0, (int8(size) -
+                     18));  // ... in units of 0x40000 bytes - that's 256 kB
+
+    displayMessage2F(STR_HW_3IN1_FORMAT_NOR);
+    // the header block is cleared along with the first slot
+    if (!index.count)
+      hwFormatNor(0, size_blocks + 1);
+    else
+      hwFormatNor(next >> 18, size_blocks);
+    pitch = next;
+
+    displayMessage2F(STR_HW_READ_GAME);
+    if (size < 15)
+      size_blocks = 1;
+    else
+      size_blocks = 1 << (uint8(size) - 15);
+    u32 LEN = min(1 << size, NOR_BLOCK);
+
+    u32 crc = 0;
+    if (backup_timing) cpuStartTiming(0);
+    for (int i = 0; i < size_blocks; i++) {
+      displayProgressBar(i + 1, size_blocks);
+      auxspi_read_data(i << 15, data, LEN, &slot_1_chip);
+      crc = crc32Update(crc, data, LEN);
+      // test if NOR memory is sane, i.e. if we can read what we just wrote
+      hwWriteNorBlock(i, data, LEN);
     }
+    hwReportNorSpeed(size_blocks * LEN);
+
+    sNDSHeader nds;
+    cardReadHeader((u8 *)&nds);  // on a Cyclops Evolution, this call *will*
+                                 // mess up your DLDI driver!
+    NorSlot *slot = &index.slot[index.count];
+    slot->seq = index.count + 1;
+    slot->offset = next;
+    slot->size_log2 = size;
+    slot->crc = crc;
+    memcpy(slot->title, nds.gameTitle, 12);
+    memcpy(slot->code, nds.gameCode, 4);
+    index.count++;
+    next += max(1 << size, 0x40000);
+
+    // only offer another game if any save would still fit
+    if ((index.count == NOR_SLOTS) || (next + 0x800000 > NOR_END)) break;
+    if (!hwAskAnother()) break;
   }
-  free(test);
 
   // Write a flag to tell the app what happens on restart.
   // This is necessary, since some DLDI drivers cease working after swapping a
@@ -468,23 +1089,21 @@ void hwBackup3in1() {
   // NOR.
   displayMessage2F(STR_HW_3IN1_PREPARE_REBOOT);
   //
-  sNDSHeader nds;
-  cardReadHeader((u8 *)&nds);  // on a Cyclops Evolution, this call *will* mess
-                               // up your DLDI driver!
   dsCardData data2;
   memset(&data2, 0, sizeof(data2));
   data2.data[0] = RS_BACKUP;
   data2.data[1] = 0;
-  data2.data[2] = size;
+  data2.data[2] = index.slot[0].size_log2;
   data2.data[3] = 0xffff00ff;
   // We need to write the reboot flags to NOR, and we can only write in
   // 32kB-blocks, at aligned offsets. Therefore we prepare a bigger block and
   // copy lots of data now.
-  memcpy(&data2.name[0], &nds.gameTitle[0], 12);
+  memcpy(&data2.name[0], index.slot[0].title, 12);
   memset(data, 0, 0x8000);
   memcpy(&data[0x1000], (u8 *)&data2, sizeof(data2));
+  memcpy(&data[NOR_INDEX], &index, sizeof(index));
   uint32 ime = hwGrab3in1();
-  WriteNorFlash(0, data, 0x8000);
+  if (!hwNorWriteHeader(data)) hwNorFailed(ime);
   hwRelease3in1(ime);
 
   displayMessage2F(STR_HW_3IN1_PLEASE_REBOOT);
@@ -493,9 +1112,48 @@ void hwBackup3in1() {
   };
 }
 
-void hwDump3in1(uint32 size, const char *gamename) {
-  u32 size_blocks = 1 << max(0, (uint8(size) - 18));
+// The reboot flag (and the index with it) is only cleared once every slot is
+//  on the card, so a dump that fails (or loses power) starts over after the
+//  next reboot. A slot that does not match its CRC is not dumped.
+void hwDump3in1Slots(const u8 *header, uint32 size, const char *gamename) {
+  NorIndex index;
+  memcpy(&index, header + NOR_INDEX, sizeof(index));
+
+  // staged by an older version: one save at 0x40000
+  if ((index.magic != NOR_INDEX_MAGIC) || !index.count ||
+      (index.count > NOR_SLOTS)) {
+    if (hwDump3in1(size, gamename)) hwFormatNor(0, 1);
+    return;
+  }
+
+  bool ok = true;
+  for (u32 i = 0; i < index.count; i++) {
+    NorSlot *slot = &index.slot[i];
+    char name[13];
+    memcpy(name, slot->title, 12);
+    name[12] = 0;
+    pitch = slot->offset;
+
+    u32 crc = 0;
+    u32 len = 1 << slot->size_log2;
+    for (u32 ofs = 0; ofs < len; ofs += NOR_BLOCK) {
+      uint32 ime = hwGrab3in1();
+      crc = Crc32NorFlash(crc, pitch + ofs, min(len - ofs, (u32)NOR_BLOCK));
+      hwRelease3in1(ime);
+    }
+    if (crc != slot->crc) {
+      displayWarning2F(STR_HW_3IN1_ERR_SLOT, name);
+      while (!(keysCurrent() & KEY_B)) {
+      };
+      continue;
+    }
+    if (!hwDump3in1(slot->size_log2, name)) ok = false;
+  }
+  pitch = 0x40000;
+  if (ok) hwFormatNor(0, 1);
+}
 
+bool hwDump3in1(uint32 size, const char *gamename) {
   displayMessageF(STR_HW_SELECT_FILE_OW);
 
   char path[256];
@@ -509,24 +1167,36 @@ void hwDump3in1(uint32 size, const char *gamename) {
   sprintf(fullpath, "%s/%s", path, fname);
   displayMessage2F(STR_HW_WRITE_FILE, fullpath);
 
-  FILE *file = fopen(fullpath, "wb");
-  if (size < 15)
-    size_blocks = 1;
-  else
-    size_blocks = 1 << (uint8(size) - 15);
-  for (u32 i = 0; i < size_blocks; i++) {
-    displayProgressBar(i + 1, size_blocks);
-    u32 LEN = min((u32)0x8000, (u32)1 << size);
-    uint32 ime = hwGrab3in1();
-    ReadNorFlash(data, (i << 15) + pitch, LEN);
-    hwRelease3in1(ime);
-    fwrite(data, 1, LEN, file);
-  }
-  fclose(file);
+  u32 total = 1 << size;
+  u32 len = min(total, min((u32)NOR_STREAM, size_buf / 2));
+  u8 *buf[2] = {data, data + len};
+  BackupWriter writer;
+  hwWriterOpen(&writer, fopen(fullpath, "wb"), data, len);
 
-  displayMessage2F(STR_HW_3IN1_DONE_DUMP, fullpath);
+  // the chips are reset once, and then stay mapped for the whole dump
+  uint32 ime = hwGrab3in1();
+  hwRelease3in1(ime);
+  u32 num_blocks = total / len;
+  hwNorDmaStart(buf[0], pitch, len);
+  for (u32 i = 0; i < num_blocks; i++) {
+    displayProgressBar(i + 1, num_blocks);
+    hwNorDmaWait(buf[i & 1], len);
+    // read ahead while this block is written
+    if (i + 1 < num_blocks)
+      hwNorDmaStart(buf[(i + 1) & 1], pitch + (i + 1) * len, len);
+    writer.buf = buf[i & 1];
+    hwWriterCommit(&writer, len);
+    hwWriterFlush(&writer);
+  }
+  CloseNorWrite();
+  bool ok = hwWriterClose(&writer);
+  if (ok)
+    displayMessage2F(STR_HW_3IN1_DONE_DUMP, fullpath);
+  else
+    displayWarning2F(STR_HW_BACKUP_WRITE_FAILED);
   while (!(keysCurrent() & KEY_B)) {
   };
+  return ok;
 }
 
 void hwRestore3in1() {
@@ -542,93 +1212,87 @@ void hwRestore3in1() {
   uint32 size0 = fileSize(msg);
 
   uint8 size = log2trunc(size0);
-  int size_blocks =
-      1 << max(
-          0, int8(size) - 18);  // ... in units of 0x40000 bytes - that's 256 kB
 
-  displayMessage2F(STR_HW_3IN1_FORMAT_NOR);
-  hwFormatNor(1, size_blocks);
+  bool psram = false;
+  if (psram_staging) {
+    displayMessage2F(STR_HW_READ_FILE, msg);
+    psram = hwStagePsram(file, 1 << size);
+    // the NOR is still there if the PSRAM does not work
+    if (!psram) fseek(file, 0, SEEK_SET);
+  }
 
-  displayMessage2F(STR_HW_READ_FILE, msg);
-  if (size < 15)
-    size_blocks = 1;
-  else
-    size_blocks = 1 << (uint8(size) - 15);
-  u8 *test = (u8 *)malloc(0x8000);
-  uint32 LEN = min(1 << size, 0x8000);
+  if (!psram) {
+    int size_blocks =
+        1 << max(0, int8(size) -
+                        18);  // ... in units of 0x40000 bytes - that's 256 kB
+
+    displayMessage2F(STR_HW_3IN1_FORMAT_NOR);
+    hwFormatNor(1, size_blocks);
+
+    displayMessage2F(STR_HW_READ_FILE, msg);
+    if (size < 15)
+      size_blocks = 1;
+    else
+      size_blocks = 1 << (uint8(size) - 15);
+    uint32 LEN = min(1 << size, NOR_BLOCK);
+
+    if (backup_timing) cpuStartTiming(0);
+    for (int i = 0; i < size_blocks; i++) {
+      displayProgressBar(i, size_blocks);
+      fread(data, 1, LEN, file);
+      hwWriteNorBlock(i, data, LEN);
+    }
+    hwReportNorSpeed(size_blocks * LEN);
 
-  for (int i = 0; i < size_blocks; i++) {
-    displayProgressBar(i, size_blocks);
-    fread(data, 1, LEN, file);
+    // the header is rewritten as it is, apart from the marker
     uint32 ime = hwGrab3in1();
-    SetSerialMode();
-    WriteNorFlash((i << 15) + pitch, data, LEN);
-    ReadNorFlash(test, (i << 15) + pitch, LEN);
+    ReadNorFlash(data, 0, NOR_BLOCK);
+    if (!hwNorWriteHeader(data)) hwNorFailed(ime);
     hwRelease3in1(ime);
-    if (*((vuint16 *)(FlashBase + 0x2002)) == 0x227E) {
-      displayMessage2F(STR_HW_3IN1_ERR_IDMODE);
-      while (1)
-        ;
-    }
-    if (memcmp(test, data, LEN)) {
-      displayMessage2F(STR_HW_3IN1_ERR_NOR);
-      while (1)
-        ;
-    }
   }
   displayProgressBar(1, 1);
   fclose(file);
-  free(test);
 
-  hwRestore3in1_b(1 << size);
+  hwRestore3in1_b(1 << size, psram);
 }
 
-void hwRestore3in1_b(uint32 size_file) {
+void hwRestore3in1_b(uint32 size_file, bool psram) {
   swap_cart();
 
   // Third, swap in a new game
-  uint32 size = auxspi_save_size_log_2(slot_1_type);
+  uint32 size = slot_1_chip.size_log2;
   while ((size_file < size) || (slot_1_type == 2)) {
     if (slot_1_type == 2)
       displayMessage2F(STR_HW_SWAP_CARD);
     else if (size_file < size)
       displayMessage2F(STR_HW_WRONG_GAME);
     swap_cart();
-    size = auxspi_save_size_log_2(slot_1_type);
+    size = slot_1_chip.size_log2;
   }
   displayPrintUpper();
 
-  uint8 type = auxspi_save_type(slot_1_type);
-  if (type == 3) {
-    displayMessage2F(STR_HW_FORMAT_GAME);
-    auxspi_erase(slot_1_type);
+  // the PSRAM may have lost the save while the cards were swapped
+  if (psram && !hwPsramValid(size_file)) {
+    displayWarning2F(STR_HW_3IN1_ERR_PSRAM);
+    while (1)
+      ;
   }
 
-  // And finally, write the save!
+  // And finally, write the save (only what differs from the game)
   displayMessage2F(STR_HW_WRITE_GAME);
-  u32 LEN = 0, num_blocks = 0, shift = 0;
-  switch (type) {
-    case 1:
-      shift = 4;  // 16 bytes
-      break;
-    case 2:
-      shift = 5;  // 32 bytes
-      break;
-    case 3:
-      shift = 8;  // 256 bytes
-      break;
-    default:
-      return;
-  }
-  LEN = 1 << shift;
-  num_blocks = 1 << (size - shift);
-
-  for (unsigned int i = 0; i < num_blocks; i++) {
-    if (i % (num_blocks >> 6) == 0) displayProgressBar(i + 1, num_blocks);
+  restore_result result;
+  if (psram) {
+    result = hwRestoreSlot1(hwSourcePsram, NULL);
+  } else {
     uint32 ime = hwGrab3in1();
-    ReadNorFlash(data, (i << shift) + pitch, LEN);
     hwRelease3in1(ime);
-    auxspi_write_data(i << shift, data, LEN, type, slot_1_type);
+    result = hwRestoreSlot1(hwSourceNor, NULL);
+    CloseNorWrite();
+  }
+  if (result != RESTORE_OK) {
+    displayWarning2F(hwRestoreError(result));
+    while (1)
+      ;
   }
   displayProgressBar(1, 1);
 
@@ -642,7 +1306,7 @@ void hwErase() {
   displayMessage2F(STR_HW_WARN_DELETE);
   while (!(keysCurrent() & (KEY_UP | KEY_R | KEY_Y))) {
   };
-  auxspi_erase(slot_1_type);
+  auxspi_erase(&slot_1_chip);
   displayMessage2F(STR_HW_DID_DELETE);
   while (1)
     ;
@@ -650,44 +1314,25 @@ void hwErase() {
 
 // --------------------------------------------------------
 void hwBackupSlot2() {
-  u32 size_blocks = 0;
-
   if (!swap_cart(true)) {
     return;
   }
   displayPrintUpper();
 
-  uint32 size = auxspi_save_size_log_2(slot_1_type);
-  uint8 type = auxspi_save_type(slot_1_type);
-
   // just select a filename, no extra work required!
   displayMessageF(STR_HW_SELECT_FILE_OW);
   char path[256];
   char fname[256] = "";
   fileSelect("/", path, fname, 0, true, false);
 
-  if (!fname[0]) {
+  bool chosen = (fname[0] != 0);
+  if (!chosen) {
     sNDSHeader nds;
     cardReadHeader((u8 *)&nds);
     find_unused_filename(nds.gameTitle, path, fname);
   }
-  char fullpath[256];
-  sprintf(fullpath, "%s/%s", path, fname);
-  displayMessage2F(STR_HW_WRITE_FILE, fullpath);
 
-  FILE *file = fopen(fullpath, "wb");
-  if (size < 8)
-    size_blocks = 1;
-  else
-    size_blocks = 1 << (size - 8);
-  // Slot 2 DLDI drivers don't seem to support writing big blocks!
-  u32 LEN = min(1 << size, 0x100);
-  for (u32 i = 0; i < size_blocks; i++) {
-    displayProgressBar(i + 1, size_blocks);
-    auxspi_read_data(i << 8, data, LEN, type, slot_1_type);
-    fwrite(data, 1, LEN, file);
-  }
-  fclose(file);
+  hwBackupSlot1(path, fname, chosen);
 
   displayProgressBar(0, 0);
   displayMessageF(STR_EMPTY);
@@ -698,8 +1343,6 @@ void hwRestoreSlot2() {
   if (!swap_cart(true)) {
     return;
   }
-  uint32 size = auxspi_save_size_log_2(slot_1_type);
-  uint8 type = auxspi_save_type(slot_1_type);
   displayPrintUpper();
 
   // second, select a save file
@@ -718,38 +1361,14 @@ void hwRestoreSlot2() {
       ;
   }
 
-  // 2a, format game if required
-  if (type == 3) {
-    displayMessage2F(STR_HW_FORMAT_GAME);
-    auxspi_erase(slot_1_type);
-  }
-
-  // and third, write save
+  // and third, write save (only what differs from the game)
   displayMessage2F(STR_HW_WRITE_GAME);
-  u32 LEN = 0, num_blocks = 0, shift = 0;
-  switch (type) {
-    case 1:
-      shift = 4;  // 16 bytes
-      break;
-    case 2:
-      shift = 5;  // 32 bytes
-      break;
-    case 3:
-      shift = 8;  // 256 bytes
-      break;
-    default:
-      return;
-  }
-  LEN = 1 << shift;
-  num_blocks = 1 << (size - shift);
-
-  for (unsigned int i = 0; i < num_blocks; i++) {
-    if (i % (num_blocks >> 6) == 0) displayProgressBar(i + 1, num_blocks);
-    fread(data, 1, LEN, file);
-    sysSetBusOwners(true, true);
-    auxspi_write_data(i << shift, data, LEN, type, slot_1_type);
-  }
+  restore_result result = hwRestoreSlot1(hwSourceFile, file);
   fclose(file);
+  if (result != RESTORE_OK) {
+    displayWarning2F(hwRestoreError(result));
+    return;
+  }
 
   displayProgressBar(0, 0);
   displayMessageF(STR_EMPTY);
@@ -758,6 +1377,27 @@ void hwRestoreSlot2() {
 // ------------------------------------------------------------
 static netbuf *buf = NULL;
 
+// Backups are sent in blocks of FTP_BLOCK (or half the buffer, if that is
+//  smaller). While a block waits for the data connection to take more, ftplib
+//  calls back (every FTP_IDLE_MS at most), and the next block is read from the
+//  game meanwhile. A write that fails FTP_RETRIES times in a row aborts.
+#define FTP_BLOCK 0x8000
+#define FTP_IDLE_MS 1
+#define FTP_RETRIES 10
+
+// local function
+bool hwSourceSlot1(u32 ofs, u8 *buf, u32 len, void *ctx) {
+  sysSetBusOwners(true, true);
+  auxspi_read_data(ofs, buf, len, (const SaveChipInfo *)ctx);
+  return true;
+}
+
+// local function
+int hwFtpIdle(netbuf *nData, int xfered, void *arg) {
+  hwPrefetchStep((RestorePrefetch *)arg);
+  return 1;
+}
+
 void hwLoginFTP() {
   int j;
   static int jmax = 10;
@@ -805,8 +1445,7 @@ void hwBackupFTP(bool dlp) {
     }
   }
   displayPrintUpper();
-  uint8 size = auxspi_save_size_log_2(slot_1_type);
-  uint8 type = auxspi_save_type(slot_1_type);
+  uint8 size = slot_1_chip.size_log2;
 
   // Second: connect to FTP server
   if (!ftp_active) hwLoginFTP();
@@ -844,25 +1483,58 @@ void hwBackupFTP(bool dlp) {
 
   // Fourth: dump save
   displayStateF(STR_EMPTY);
-  FtpAccess(fname, FTPLIB_FILE_WRITE, FTPLIB_IMAGE, buf, &ndata);
-  u32 length = 1 << 9;
-  int num_ftp_blocks = 1 << (size - 9);
-  for (int i = 0; i < num_ftp_blocks; i++) {
-    displayProgressBar(i + 1, num_ftp_blocks);
-    auxspi_read_data(i << 9, (u8 *)&data[0], length, type, slot_1_type);
-    u32 out = 0;
-    while (out < length) {
-      u32 delta = FtpWrite((u8 *)&data[out], length - out, ndata);
-      out += delta;
-      if (delta == 0) {
+  if (!FtpAccess(fname, FTPLIB_FILE_WRITE, FTPLIB_IMAGE, buf, &ndata)) {
+    displayWarning2F(STR_HW_FTP_READ_ONLY);
+    if (dlp)
+      while (1)
+        ;
+    return;
+  }
+  u32 total = 1 << size;
+  u32 block = min(total, min((u32)FTP_BLOCK, size_buf / 2));
+  u8 *stage[2] = {data, data + block};
+  RestorePrefetch pf = {hwSourceSlot1, (void *)&slot_1_chip, stage[0], 0,
+                        block, 0, true};
+  FtpOptions(FTPLIB_CALLBACK, (long)hwFtpIdle, ndata);
+  FtpOptions(FTPLIB_CALLBACKARG, (long)&pf, ndata);
+  FtpOptions(FTPLIB_IDLETIME, FTP_IDLE_MS, ndata);
+  // the messages are only updated when the state of the connection changes
+  enum { FTP_SENDING, FTP_SLOW, FTP_READ_ONLY } shown = FTP_SENDING;
+  u32 num_blocks = total / block;
+  int failed = 0;
+  for (u32 ofs = 0, n = 0; (ofs < total) && (failed < FTP_RETRIES);
+       ofs += block, n++) {
+    displayProgressBar(n + 1, num_blocks);
+    // whatever is left of this block (all of it, for the first one)
+    while (hwPrefetchStep(&pf))
+      ;
+    u8 *out = pf.buf;
+
+    // start on the next block
+    pf.buf = stage[(n + 1) & 1];
+    pf.ofs = ofs + block;
+    pf.len = (ofs + block < total) ? block : 0;
+    pf.done = 0;
+
+    for (u32 sent = 0; (sent < block) && (failed < FTP_RETRIES);) {
+      u32 delta = FtpWrite(out + sent, block - sent, ndata);
+      sent += delta;
+      if (!delta) {
+        failed++;
+        swiDelay(10000);
+      } else
+        failed = 0;
+      if (!delta && (shown != FTP_READ_ONLY)) {
         displayMessage2F(STR_HW_FTP_READ_ONLY);
-      } else {
+        shown = FTP_READ_ONLY;
+      } else if (delta && (sent < block) && (shown != FTP_SLOW)) {
         displayMessage2F(STR_HW_WRITE_FILE, fname);
-      }
-      if (delta < length) {
         displayStateF(STR_HW_FTP_SLOW);
-      } else {
+        shown = FTP_SLOW;
+      } else if (delta && (sent == block) && (shown != FTP_SENDING)) {
         displayMessage2F(STR_HW_WRITE_FILE, fname);
+        displayStateF(STR_EMPTY);
+        shown = FTP_SENDING;
       }
     }
   }
@@ -871,7 +1543,12 @@ void hwBackupFTP(bool dlp) {
 
   // Wifi_DisconnectAP();
 
-  if (dlp) {
+  if (failed) {
+    displayWarning2F(STR_HW_FTP_READ_ONLY);
+    if (dlp)
+      while (1)
+        ;
+  } else if (dlp) {
     displayMessage2F(STR_HW_PLEASE_REBOOT);
     while (1)
       ;
@@ -881,57 +1558,16 @@ void hwBackupFTP(bool dlp) {
   displayMessageF(STR_EMPTY);
 }
 
-// an internal function used to read big files from the FTP server
-bool hwRestoreFTPPartial(u32 ofs, u32 size, u32 type, netbuf *ndata) {
-  int num_blocks_ftp = 1 << (size - 9);
-  u8 *pdata = data;
-  for (int i = 0; i < num_blocks_ftp; i++) {
-    displayProgressBar(i + 1, num_blocks_ftp);
-    int in = 0;
-    while (in < 512) {
-      int delta = FtpRead((u8 *)&pdata[in], 512 - in, ndata);
-      in += delta;
-      if (delta < 512)
-        displayStateF(STR_HW_FTP_SLOW);
-      else
-        displayStateF(STR_EMPTY);
-    }
-    pdata += 512;
-  }
-
-  // Write to game
-  u32 LEN = 0, shift = 0;
-  switch (type) {
-    case 1:
-      shift = 4;  // 16 bytes
-      break;
-    case 2:
-      shift = 5;  // 32 bytes
-      break;
-    case 3:
-      shift = 8;  // 256 bytes
-      break;
-    default:
-      return false;
-  }
-  LEN = 1 << shift;
-  if (type == 3) {
-    displayMessage2F(STR_HW_FORMAT_GAME);
-    u32 sector = ofs >> 16;
-    u32 num = max(u32(0), size - 16);
-    for (int i = 0; i < (1 << num); i++) {
-      displayProgressBar(i + 1, 1 << num);
-      auxspi_erase_sector(sector + i, slot_1_type);
-    }
-    displayProgressBar(0, 0);
-  }
-  displayMessage2F(STR_HW_WRITE_GAME);
-  for (int i = 0; i < (1 << (size - shift)); i++) {
-    displayProgressBar(i + 1, 1 << (size - shift));
-    auxspi_write_data(ofs + (i << shift), ((u8 *)data) + (i << shift), LEN,
-                      type, slot_1_type);
+// local function: the save is restored while it is downloaded (see
+//  hwRestoreSlot1). Nothing is padded: if the download ends early, the source
+//  fails and the sector is left alone.
+bool hwSourceFtp(u32 ofs, u8 *buf, u32 len, void *ctx) {
+  u32 in = 0;
+  while (in < len) {
+    int delta = FtpRead(buf + in, len - in, (netbuf *)ctx);
+    if (delta <= 0) return false;
+    in += delta;
   }
-
   return true;
 }
 
@@ -955,23 +1591,31 @@ void hwRestoreFTP(bool dlp) {
   // Third: swap card
   if (!dlp) swap_cart();
   displayPrintUpper();
-  uint8 size = auxspi_save_size_log_2(slot_1_type);
-  uint8 type = auxspi_save_type(slot_1_type);
-
-  // Fourth: read file
-  u8 data_log2 = log2trunc(size_buf);
-  int num_read_blocks = (size > data_log2) ? (1 << (size - data_log2)) : 1;
-  int len_block = min(data_log2, size);
-  FtpAccess(fname, FTPLIB_FILE_READ, FTPLIB_IMAGE, buf, &ndata);
-  // read save in multiple blocks, if required
-  for (int i = 0; i < num_read_blocks; i++) {
-    char ctr[32];
-    sprintf(ctr, "%i/%i", i + 1, num_read_blocks);
-    displayMessage2F(STR_HW_READ_FILE, fname);
-    displayMessageF(STR_STR, ctr);
-    hwRestoreFTPPartial(i << len_block, len_block, type, ndata);
+
+  // Fourth: read file and write it to the game, one sector at a time; a
+  //  sector is only erased once all of its data has arrived. A file smaller
+  //  than the chip is refused (or fails the download, if the server does not
+  //  tell its size) instead of being padded.
+  int tsize = 0;
+  if (FtpSize(fname, &tsize, FTPLIB_IMAGE, buf) && (tsize >= 0) &&
+      ((u32)tsize < (1u << slot_1_chip.size_log2))) {
+    displayWarning2F(STR_HW_RESTORE_NOT_STARTED);
+    if (dlp)
+      while (1)
+        ;
+    return;
+  }
+  if (!FtpAccess(fname, FTPLIB_FILE_READ, FTPLIB_IMAGE, buf, &ndata)) {
+    displayWarning2F(STR_HW_FTP_ERR_FTP);
+    if (dlp)
+      while (1)
+        ;
+    return;
   }
+  displayMessage2F(STR_HW_WRITE_GAME);
+  restore_result result = hwRestoreSlot1(hwSourceFtp, ndata);
   FtpClose(ndata);
+  if (result != RESTORE_OK) displayWarning2F(hwRestoreError(result));
   // FtpQuit(buf);
 
   // Wifi_DisconnectAP();
@@ -986,6 +1630,135 @@ void hwRestoreFTP(bool dlp) {
   displayMessageF(STR_EMPTY);
 }
 
+// ------------------------------------------------------------
+// Automatic snapshots of GBA saves: before a save is modified, the original is
+//  written to "/backups/<gamecode>/<timestamp>.sav". The file is written in
+//  small chunks while the ticket is injected, and it is always complete, synced
+//  and renamed to its final name before anything on the cart is touched, so
+//  there is a good copy at any time. Writing it takes as long as writing any
+//  other file of this size.
+#define SNAPSHOT_CHUNK 0x1000
+
+static struct {
+  FILE *file;
+  const u8 *src;
+  u32 len;
+  u32 done;
+  bool failed;
+  char dir[32];
+  char path[64];  // the data goes to path + ".tmp" until it is complete
+} snapshot = {NULL, NULL, 0, 0, false, "", ""};
+
+bool hwFatReady() {
+  static int fat = 0;  // 0: not tried yet, 1: ready, -1: failed
+  if (fat == 0) fat = fatInitDefault() ? 1 : -1;
+  return fat > 0;
+}
+
+// local function: deletes the oldest snapshots, until at most "keep" remain.
+//  File names are timestamps, so alphabetical order is chronological order.
+void hwSnapshotPrune(const char *dir, int keep) {
+  while (1) {
+    DIR *pdir = opendir(dir);
+    if (!pdir) return;
+    int count = 0;
+    char oldest[256] = "";
+    struct dirent *ent;
+    while ((ent = readdir(pdir)) != NULL) {
+      const char *ext = strrchr(ent->d_name, '.');
+      if (!ext || strcasecmp(ext, ".sav")) continue;
+      count++;
+      if (!oldest[0] || (strcmp(ent->d_name, oldest) < 0))
+        strncpy(oldest, ent->d_name, 255);
+    }
+    closedir(pdir);
+    if (count <= keep) return;
+    sprintf(txt, "%s/%s", dir, oldest);
+    if (remove(txt)) return;
+  }
+}
+
+snapshot_state hwSnapshotBegin(const u8 *save, u32 len) {
+  hwSnapshotFinish();
+  snapshot.failed = false;
+  if (!gba_snapshot || (snapshot_keep <= 0)) return SNAPSHOT_OFF;
+  if (!hwFatReady()) {
+    snapshot.failed = true;
+    return SNAPSHOT_FAILED;
+  }
+
+  // the game code is used as the folder name
+  char code[5];
+  memcpy(code, (char *)0x080000ac, 4);
+  code[4] = 0;
+  for (int i = 0; i < 4; i++)
+    if (!isalnum((unsigned char)code[i])) code[i] = '_';
+
+  mkdir("/backups", 0777);
+  sprintf(snapshot.dir, "/backups/%s", code);
+  mkdir(snapshot.dir, 0777);
+
+  // two snapshots within the same second get a suffix ('_' sorts after '.',
+  //  so the order stays chronological)
+  time_t now = time(NULL);
+  struct tm *t = localtime(&now);
+  char stamp[20];
+  sprintf(stamp, "%04i%02i%02i-%02i%02i%02i", t->tm_year + 1900, t->tm_mon + 1,
+          t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec);
+  sprintf(snapshot.path, "%s/%s.sav", snapshot.dir, stamp);
+  for (int i = 1; fileExists(snapshot.path); i++) {
+    if (i > 99) {
+      snapshot.failed = true;
+      return SNAPSHOT_FAILED;
+    }
+    sprintf(snapshot.path, "%s/%s_%02i.sav", snapshot.dir, stamp, i);
+  }
+
+  sprintf(txt, "%s.tmp", snapshot.path);
+  snapshot.file = fopen(txt, "wb");
+  if (!snapshot.file) {
+    snapshot.failed = true;
+    return SNAPSHOT_FAILED;
+  }
+
+  snapshot.src = save;
+  snapshot.len = len;
+  snapshot.done = 0;
+  return SNAPSHOT_STARTED;
+}
+
+bool hwSnapshotStep() {
+  if (!snapshot.file || snapshot.failed) return false;
+  u32 sublen = min(snapshot.len - snapshot.done, (u32)SNAPSHOT_CHUNK);
+  if (fwrite(snapshot.src + snapshot.done, 1, sublen, snapshot.file) != sublen) {
+    // card full or removed; hwSnapshotFinish() cleans up
+    snapshot.failed = true;
+    return false;
+  }
+  snapshot.done += sublen;
+  return snapshot.done < snapshot.len;
+}
+
+bool hwSnapshotFinish() {
+  if (!snapshot.file) return !snapshot.failed;
+  while (hwSnapshotStep())
+    ;
+  if (fflush(snapshot.file) || fsync(fileno(snapshot.file)))
+    snapshot.failed = true;
+  if (fclose(snapshot.file)) snapshot.failed = true;
+  snapshot.file = NULL;
+
+  sprintf(txt, "%s.tmp", snapshot.path);
+  if (!snapshot.failed && rename(txt, snapshot.path)) snapshot.failed = true;
+  if (snapshot.failed) {
+    remove(txt);
+    return false;
+  }
+  // only now that the new snapshot is safe, the oldest one may go
+  hwSnapshotPrune(snapshot.dir, snapshot_keep);
+  return true;
+}
+
 // ------------------------------------------------------------
 void GBA_read_inject_restore(u8 type, char *ticket, SupportedGames games, Language language) {
   // Read savedata
@@ -1003,6 +1776,21 @@ void GBA_read_inject_restore(u8 type, char *ticket, SupportedGames games, Langua
   uint32 size = gbaGetSaveSize(type);
   gbaReadSave(data, 0, size, type);
 
+  // Keep an untouched copy of the save for the snapshot, so it can be written
+  //  while we are working on the cart. If there is no room for a copy, write
+  //  the snapshot right now. Nothing is injected without the snapshot, unless
+  //  snapshots are turned off.
+  u8 *original = (size_buf >= 2 * size) ? data + size : data;
+  if (original != data) memcpy(original, data, size);
+  snapshot_state state = hwSnapshotBegin(original, size);
+  if ((state == SNAPSHOT_FAILED) ||
+      ((state == SNAPSHOT_STARTED) && (original == data) &&
+       !hwSnapshotFinish())) {
+    displayWarning2F(STR_HW_SNAPSHOT_FAILED);
+    return;
+  }
+  hwSnapshotStep();
+
   // Inject selected ticket
   int ret = 0;
   if (ticket[4] == 0x33 
@@ -1012,9 +1800,18 @@ void GBA_read_inject_restore(u8 type, char *ticket, SupportedGames games, Langua
   else
     ret = wc_inject((char *)data, ticket, games, language);
 
+  hwSnapshotStep();
+
   if (ret != 1) {
+    hwSnapshotFinish();
     displayPrintTicketError(ret);
   } else {
+    // The snapshot must be safe before the only other copy is erased.
+    if (!hwSnapshotFinish()) {
+      displayWarning2F(STR_HW_SNAPSHOT_FAILED);
+      return;
+    }
+
     // Restore save to cart
     if ((type == 4) || (type == 5)) {
       displayMessage2F(STR_HW_FORMAT_GAME);
@@ -1023,6 +1820,10 @@ void GBA_read_inject_restore(u8 type, char *ticket, SupportedGames games, Langua
 
     displayMessage2F(STR_HW_WRITE_GAME);
     gbaWriteSave(0, data, size, type);
+    if (!gbaVerifySave(0, data, size, type)) {
+      displayWarning2F(STR_HW_VERIFY_FAILED);
+      return;
+    }
 
 ////ENG_TEXT_START
     displayStateF(STR_STR, "Done!");
@@ -1048,8 +1849,11 @@ void hwBackupGBA(u8 type) {
   char fname[256] = "";
   fileSelect("/", path, fname, 0, true, false);
 
+  // New backups go to the backup store (unless disabled), an existing file is
+  //  overwritten in its own format.
   if (!fname[0]) {
-    find_unused_filename((char *)0x080000a0, path, fname);
+    find_unused_filename((char *)0x080000a0, path, fname,
+                         backup_store ? "man" : "sav");
   }
   char fullpath[512];
   sprintf(fullpath, "%s/%s", path, fname);
@@ -1059,9 +1863,16 @@ void hwBackupGBA(u8 type) {
   gbaReadSave(data, 0, size, type);
 
   displayMessage2F(STR_HW_WRITE_FILE, fullpath);
-  FILE *file = fopen(fullpath, "wb");
-  fwrite(data, 1, size, file);
-  fclose(file);
+  if (storeIsManifest(fname)) {
+    if (!storeWriteBackup(fullpath, data, size, type)) {
+      displayWarning2F(STR_HW_STORE_WRITE_FAILED);
+      return;
+    }
+  } else {
+    FILE *file = fopen(fullpath, "wb");
+    fwrite(data, 1, size, file);
+    fclose(file);
+  }
 
   displayStateF(STR_STR, "Done!");
   // while(1);
@@ -1088,9 +1899,17 @@ void hwRestoreGBA() {
   sprintf(fullpath, "%s/%s", path, fname);
 
   displayMessage2F(STR_HW_READ_FILE, fname);
-  FILE *file = fopen(fullpath, "rb");
-  fread(data, 1, size, file);
-  fclose(file);
+  if (storeIsManifest(fname)) {
+    // a backup from the store must be complete and match the cart
+    if (storeReadBackup(fullpath, data, size_buf) != size) {
+      displayWarning2F(STR_HW_STORE_DAMAGED);
+      return;
+    }
+  } else {
+    FILE *file = fopen(fullpath, "rb");
+    fread(data, 1, size, file);
+    fclose(file);
+  }
 
   if ((type == 4) || (type == 5)) {
     displayMessage2F(STR_HW_FORMAT_GAME);
@@ -1099,6 +1918,10 @@ void hwRestoreGBA() {
 
   displayMessage2F(STR_HW_WRITE_GAME);
   gbaWriteSave(0, data, size, type);
+  if (!gbaVerifySave(0, data, size, type)) {
+    displayWarning2F(STR_HW_VERIFY_FAILED);
+    return;
+  }
 
   displayStateF(STR_STR, "Done!");
   /*
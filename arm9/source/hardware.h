@@ -64,9 +64,15 @@ bool swap_cart(bool allow_cancel = false);
 u32 hwDetect();
 
 void hwBackup3in1();
-void hwDump3in1(uint32 size, const char* gamename);
+// Returns false if the backup file could not be written.
+bool hwDump3in1(uint32 size, const char* gamename);
+// Dumps all saves staged by hwBackup3in1 after the reboot. "header" is the
+//  first 32 kB of the NOR; "size" and "gamename" come from the reboot flag, for
+//  saves staged by older versions. The reboot flag is only cleared once all
+//  of them are written.
+void hwDump3in1Slots(const u8* header, uint32 size, const char* gamename);
 void hwRestore3in1();
-void hwRestore3in1_b(uint32 size_file);
+void hwRestore3in1_b(uint32 size_file, bool psram = false);
 void hwErase();
 
 void hwBackupDSi();
@@ -75,6 +81,23 @@ void hwRestoreDSi();
 void hwBackupFTP(bool dlp = false);
 void hwRestoreFTP(bool dlp = false);
 
+// Snapshots of a save that is about to be modified. "save" must stay untouched
+//  until hwSnapshotFinish() is called; hwSnapshotStep() writes the next chunk
+//  and returns false when done. hwSnapshotFinish() returns false if a snapshot
+//  was started but could not be written completely (nothing is left behind).
+//  hwSnapshotBegin() fails if snapshots are enabled but there is no card to
+//  write them to.
+typedef enum {
+  SNAPSHOT_OFF,
+  SNAPSHOT_STARTED,
+  SNAPSHOT_FAILED
+} snapshot_state;
+
+bool hwFatReady();
+snapshot_state hwSnapshotBegin(const u8* save, u32 len);
+bool hwSnapshotStep();
+bool hwSnapshotFinish();
+
 void GBA_read_inject_restore(u8 type, char* ticket, SupportedGames games, Language language);
 void hwBackupGBA(u8 type);
 void hwRestoreGBA();
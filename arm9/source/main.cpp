@@ -36,6 +36,7 @@
 
 #include <algorithm>
 
+#include "auxspi.h"
 #include "display.h"
 #include "dsCard.h"
 #include "fileselect.h"
@@ -49,8 +50,11 @@
 #include "supported_games.h"
 
 using std::max;
+using std::min;
 
 char bootdir[256] = "/";
+// the language file named in the ini file, if any
+char langfile[256] = "";
 
 #define LIBNDS_VER \
   ((_LIBNDS_MAJOR_ << 16) | (_LIBNDS_MINOR_ << 8) | (_LIBNDS_PATCH_))
@@ -189,8 +193,7 @@ void mode_3in1() {
     name[12] = 0;
     displayMessageF(
         STR_HW_3IN1_CLEAR_FLAG);  // lower screen is used for file browser
-    hwFormatNor(0, 1);            // clear reboot flag
-    hwDump3in1(size, name);
+    hwDump3in1Slots(data, size, name);
   }
   displayMessageF(STR_EMPTY);
   displayProgressBar(0, 0);
@@ -896,11 +899,10 @@ void mode_dlp() {
   }
 }
 
+// The ini file is optional: without a memory card (e.g. in DLP mode) or without
+//  the file, all options keep their defaults and false is returned.
 bool loadIniFile(char* path) {
-  // Don't try to load ini file in DLP mode, we need to get our options from a
-  // different source.
-  //  Still trying to figure something out...
-  if (mode == 5) return true;
+  if (!hwFatReady()) return false;
 
   ini_fd_t ini = 0;
 
@@ -918,10 +920,10 @@ bool loadIniFile(char* path) {
     if (fileExists(inipath)) ini = ini_open(inipath, "r", "");
   }
   if (!ini) {
-    // displayWarning2F(STR_BOOT_NO_INI);
-    iprintf("could not find ini file!");
-    while (1)
-      ;
+#ifdef DEBUG
+    iprintf("could not find ini file!\n");
+#endif
+    return false;
   }
 
 #ifdef DEBUG
@@ -942,28 +944,73 @@ bool loadIniFile(char* path) {
   ini_readInt(ini, &ir_delay);
   ir_delay = max(ir_delay, 1000);
 
-  if (ini_locateKey(ini, "slot2")) ini_readInt(ini, &slot2);
+  if (ini_locateKey(ini, "slot2") == 0) ini_readInt(ini, &slot2);
+
+  if (ini_locateKey(ini, "snapshot_keep") == 0) {
+    ini_readInt(ini, &snapshot_keep);
+    gba_snapshot = (snapshot_keep > 0);
+  }
+  if (ini_locateKey(ini, "backup_store") == 0) {
+    int tmp;
+    ini_readInt(ini, &tmp);
+    backup_store = (tmp != 0);
+  }
+  if (ini_locateKey(ini, "dldi_max_write") == 0)
+    ini_readInt(ini, &dldi_max_write);
+  if (ini_locateKey(ini, "backup_timing") == 0) {
+    int tmp;
+    ini_readInt(ini, &tmp);
+    backup_timing = (tmp != 0);
+  }
+  if (ini_locateKey(ini, "nor_verify") == 0) {
+    ini_readInt(ini, &nor_verify);
+    nor_verify = min(max(nor_verify, NOR_VERIFY_NONE), NOR_VERIFY_FULL);
+  }
+  if (ini_locateKey(ini, "psram_staging") == 0) {
+    int tmp;
+    ini_readInt(ini, &tmp);
+    psram_staging = (tmp != 0);
+  }
 
-  // load additional Flash chip signatures (JEDEC IDs)
+  // load additional Flash chip signatures (JEDEC IDs), numbered from 0 on; a
+  //  missing number does not end the list
   ini_locateHeading(ini, "new chips");
-  for (int i = 0; i < EXTRA_ARRAY_SIZE; i++) {
+  for (int i = 0; i < JEDEC_USER_MAX; i++) {
     int tmp;
     sprintf(txt, "%i-id", i);
-    ini_locateKey(ini, txt);
+    if (ini_locateKey(ini, txt)) continue;
     ini_readString(ini, txt, 256);
+    JedecChip chip = {0, 0, 256, 0};
     sscanf(txt, "%x", &tmp);
-    extra_id[i] = (u32)tmp;
+    chip.jedec = (u32)tmp;
+    // Macronix chips have a 4 kB erase
+    if ((chip.jedec >> 16) == 0xc2) chip.flags |= JEDEC_SUBSECTOR;
     //
     sprintf(txt, "%i-size", i);
-    ini_locateKey(ini, txt);
+    if (ini_locateKey(ini, txt)) continue;
     ini_readInt(ini, &tmp);
-    extra_size[i] = tmp;
+    // 64 kB (one erase sector) to 8 MB
+    chip.size_log2 = min(max(tmp, 16), 23);
+    // optional: page size and flags
+    sprintf(txt, "%i-page", i);
+    if (ini_locateKey(ini, txt) == 0) {
+      ini_readInt(ini, &tmp);
+      // a power of 2 from 16 to 256 bytes
+      tmp = min(max(tmp, 16), 256);
+      chip.page = 16;
+      while (chip.page * 2 <= tmp) chip.page *= 2;
+    }
+    sprintf(txt, "%i-flags", i);
+    if (ini_locateKey(ini, txt) == 0) {
+      ini_readInt(ini, &tmp);
+      chip.flags = tmp;
+    }
+    auxspi_add_chip(&chip);
   }
 
-  txt[0] = 0;
   ini_locateHeading(ini, "");
-  ini_locateKey(ini, "language");
-  ini_readString(ini, txt, 256);
+  if (ini_locateKey(ini, "language") == 0)
+    ini_readString(ini, langfile, 256);
 
   ini_close(ini);
 
@@ -1031,39 +1078,23 @@ int main(int argc, char* argv[]) {
       iprintf("Found DLDI: %s\n", io_dldi_data->friendlyName);
   #endif
   */
+  // Load the ini file with the FTP settings and more options. This comes
+  //  first, since hwDetect already identifies the Slot 1 chip ([new chips]).
+  //  It also runs "fatInitDefault" (hwFatReady) before hwDetect, which is
+  //  harmless as long as nothing is concluded from its result: on the DSi it
+  //  may succeed without a flash card (see hwDetect), and then the ini file is
+  //  simply not found.
+#ifdef DEBUG
+  iprintf("Loading INI file\n");
+#endif
+  loadIniFile(has_argv(argc, argv) ? argv[0] : NULL);
+
   // detect hardware
   mode = hwDetect();
-  /*
-      // Load the ini file with the FTP settings and more options
-      for (int i = 0; i < EXTRA_ARRAY_SIZE; i++) {
-          extra_id[i] = 0xff000000;
-          extra_size[i] = 0;
-      }
-
-  #ifdef DEBUG
-      iprintf("Loading INI file\n");
-  #endif
-      if (has_argv(argc, argv)) {
-  #ifdef DEBUG
-          iprintf("argv folder: %s\n", argv[0]);
-  #endif
-          loadIniFile(argv[0]);
-      } else {
-  #ifdef DEBUG
-          iprintf("Bad/no argv folder!\n", argv[0]);
-  #endif
-          loadIniFile(0);
-      }
-  #ifdef DEBUG
-      iprintf("Done!\n");
-  #endif
-  */
   if (slot2 > 0) mode = 4;
 
   // load strings
-  // "txt" is used as a temp buffer for the language file name, returned by
-  // hwDetect
-  stringsLoadFile(txt);
+  stringsLoadFile(langfile);
 
   // prepare the global data buffer
   data = (u8*)malloc(size_buf);
@@ -0,0 +1,173 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * savestore.cpp: A deduplicating backup store on the memory card.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include "savestore.h"
+
+#include <nds.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "crc32.h"
+#include "fileselect.h"
+
+using std::min;
+
+// local function: the high word is the CRC32, the low word is FNV-1a, which is
+//  unrelated enough to make a collision of both practically impossible.
+u64 storeHash(const u8 *buf, u32 len) {
+  u32 fnv = 0x811c9dc5;
+  for (u32 i = 0; i < len; i++) fnv = (fnv ^ buf[i]) * 0x01000193;
+  return ((u64)crc32(buf, len) << 32) | fnv;
+}
+
+// local function: sectors are spread over 256 subfolders, so no single folder
+//  grows large enough to make FAT lookups slow.
+void storeSectorPath(char *path, u64 key) {
+  u32 hi = (u32)(key >> 32);
+  u32 lo = (u32)key;
+  sprintf(path, "%s/%02lx/%08lx%08lx.bin", STORE_DIR, hi >> 24, hi, lo);
+}
+
+bool storeIsManifest(const char *fname) {
+  const char *ext = strrchr(fname, '.');
+  return ext && !strcasecmp(ext, ".man");
+}
+
+// local function: true if the sector file "path" holds exactly "len" bytes
+//  with the hash "key"
+bool storeSectorOkay(const char *path, u64 key, u32 len) {
+  // one byte more, to notice a file that is too long
+  static u8 sector[STORE_SECTOR + 1];
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  u32 in = fread(sector, 1, sizeof(sector), file);
+  fclose(file);
+  return (in == len) && (storeHash(sector, len) == key);
+}
+
+// local function: adds one sector to the store. It is written to a temporary
+//  file first, so an interrupted write never leaves a damaged sector behind.
+//  An existing sector is only trusted if it reads back with the right size and
+//  hash; otherwise it is replaced. Returns 1 if the sector was written, 0 if it
+//  existed already, -1 on error.
+int storePutSector(u64 key, const u8 *buf, u32 len) {
+  char path[64];
+  storeSectorPath(path, key);
+  bool exists = fileExists(path);
+  if (exists && storeSectorOkay(path, key, len)) return 0;
+
+  char tmp[64];
+  sprintf(tmp, "%s/%02lx", STORE_DIR, (u32)(key >> 56));
+  mkdir(tmp, 0777);
+  sprintf(tmp, "%s.tmp", path);
+  FILE *file = fopen(tmp, "wb");
+  if (!file) return -1;
+  bool ok = (fwrite(buf, 1, len, file) == len);
+  if (fclose(file)) ok = false;
+  // rename does not replace an existing file on FAT
+  if (ok && exists) remove(path);
+  if (!ok || rename(tmp, path)) {
+    remove(tmp);
+    return -1;
+  }
+  return 1;
+}
+
+bool storeWriteBackup(const char *fullpath, const u8 *buf, u32 size, u8 type,
+                      u32 *new_sectors) {
+  mkdir("/backups", 0777);
+  mkdir(STORE_DIR, 0777);
+
+  StoreManifest man;
+  man.magic = STORE_MAGIC;
+  man.version = STORE_VERSION;
+  man.type = type;
+  man.reserved = 0;
+  man.size = size;
+  man.crc = crc32(buf, size);
+  man.count = (size + STORE_SECTOR - 1) / STORE_SECTOR;
+
+  FILE *file = fopen(fullpath, "wb");
+  if (!file) return false;
+  bool ok = (fwrite(&man, sizeof(man), 1, file) == 1);
+
+  u32 added = 0;
+  for (u32 ofs = 0; ok && (ofs < size); ofs += STORE_SECTOR) {
+    u32 len = min(size - ofs, (u32)STORE_SECTOR);
+    u64 key = storeHash(buf + ofs, len);
+    int res = storePutSector(key, buf + ofs, len);
+    if (res < 0) ok = false;
+    added += res;
+    if (ok) ok = (fwrite(&key, sizeof(key), 1, file) == 1);
+  }
+  if (fclose(file)) ok = false;
+
+  // a manifest pointing at missing sectors is worse than no manifest at all
+  if (!ok) remove(fullpath);
+  if (new_sectors) *new_sectors = added;
+  return ok;
+}
+
+u32 storeReadBackup(const char *fullpath, u8 *buf, u32 maxsize, u8 *type) {
+  FILE *file = fopen(fullpath, "rb");
+  if (!file) return 0;
+
+  StoreManifest man;
+  if ((fread(&man, sizeof(man), 1, file) != 1) || (man.magic != STORE_MAGIC) ||
+      (man.version != STORE_VERSION) || (man.size > maxsize) ||
+      (man.count != (man.size + STORE_SECTOR - 1) / STORE_SECTOR)) {
+    fclose(file);
+    return 0;
+  }
+
+  bool ok = true;
+  char path[64];
+  for (u32 ofs = 0; ok && (ofs < man.size); ofs += STORE_SECTOR) {
+    u32 len = min(man.size - ofs, (u32)STORE_SECTOR);
+    u64 key;
+    if (fread(&key, sizeof(key), 1, file) != 1) {
+      ok = false;
+      break;
+    }
+    storeSectorPath(path, key);
+    FILE *sector = fopen(path, "rb");
+    if (!sector) {
+      ok = false;
+      break;
+    }
+    ok = (fread(buf + ofs, 1, len, sector) == len);
+    fclose(sector);
+  }
+  fclose(file);
+
+  // the CRC over the whole save catches damaged sector files
+  if (!ok || (crc32(buf, man.size) != man.crc)) return 0;
+  if (type) *type = man.type;
+  return man.size;
+}
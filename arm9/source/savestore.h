@@ -0,0 +1,71 @@
+/*
+ * savegame_manager: a tool to backup and restore savegames from Nintendo
+ *  DS cartridges. Nintendo DS and all derivative names are trademarks
+ *  by Nintendo. EZFlash 3-in-1 is a trademark by EZFlash.
+ *
+ * savestore.h: A deduplicating backup store on the memory card.
+ *
+ * Copyright (C) Pokedoc (2010)
+ */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef SAVESTORE_H
+#define SAVESTORE_H
+
+#include <nds.h>
+
+// Backups in the store are split into 4 kB sectors (the size of a Gen3 save
+//  section). Every sector is saved once below STORE_DIR, named by a 64 bit
+//  hash of its contents. A backup itself is only a small manifest file listing
+//  these hashes, so repeated backups of the same cart only cost the sectors
+//  that actually changed.
+// The store only grows: manifests can be anywhere on the card, so there is no
+//  safe way to tell that a sector is no longer used, and sectors are never
+//  deleted. Deleting a manifest does not free the space of its sectors; to
+//  reclaim it, delete STORE_DIR together with all manifests.
+#define STORE_DIR "/backups/.store"
+#define STORE_SECTOR 0x1000
+#define STORE_MAGIC 0x4d4d4753  // "SGMM"
+#define STORE_VERSION 1
+
+struct StoreManifest {
+  u32 magic;
+  u16 version;
+  u8 type;  // save type, as returned by gbaGetSaveType()
+  u8 reserved;
+  u32 size;   // size of the save
+  u32 crc;    // CRC32 of the complete save
+  u32 count;  // number of sector hashes following this header
+};
+
+// Returns true if "fname" looks like a manifest (i.e. ends with ".man").
+bool storeIsManifest(const char *fname);
+
+// Writes "buf" to the store and creates the manifest "fullpath". If
+//  "new_sectors" is given, it receives the number of sectors that were not
+//  yet in the store.
+bool storeWriteBackup(const char *fullpath, const u8 *buf, u32 size, u8 type,
+                      u32 *new_sectors = NULL);
+
+// Rebuilds the save described by the manifest "fullpath" in "buf". Returns the
+//  size of the save, or 0 if the manifest or a sector is missing/damaged or if
+//  the save does not fit in "maxsize".
+u32 storeReadBackup(const char *fullpath, u8 *buf, u32 maxsize,
+                    u8 *type = NULL);
+
+#endif  // SAVESTORE_H
@@ -180,6 +180,24 @@ bool stringsLoadFile(const char *fname) {
   AddString(STR_FS_WRITE, ini);
   //
   AddString(STR_MM_WIPE, ini);
+  //
+  AddString(STR_HW_VERIFY_FAILED, ini);
+  //
+  AddString(STR_HW_STORE_DAMAGED, ini);
+  AddString(STR_HW_STORE_WRITE_FAILED, ini);
+  //
+  AddString(STR_HW_ALREADY_BACKED_UP, ini);
+  //
+  AddString(STR_HW_3IN1_ERR_PSRAM, ini);
+  AddString(STR_HW_3IN1_ANOTHER, ini);
+  AddString(STR_HW_3IN1_ERR_SLOT, ini);
+  //
+  AddString(STR_HW_SNAPSHOT_FAILED, ini);
+  //
+  AddString(STR_HW_RESTORE_NOT_STARTED, ini);
+  AddString(STR_HW_RESTORE_READ_FAILED, ini);
+  //
+  AddString(STR_HW_BACKUP_WRITE_FAILED, ini);
 
   // delete temp file (which is a remnant of inilib)
   remove("/tmpfile");
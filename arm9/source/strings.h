@@ -92,6 +92,31 @@ enum {
   // messages for the main menu (39)
   STR_MM_WIPE,
   //
+  // verify messages (40)
+  STR_HW_VERIFY_FAILED,
+  //
+  // backup store messages (41-42)
+  STR_HW_STORE_DAMAGED,
+  STR_HW_STORE_WRITE_FAILED,
+  //
+  // backup messages (43)
+  STR_HW_ALREADY_BACKED_UP,
+  //
+  // 3in1 messages (44-46)
+  STR_HW_3IN1_ERR_PSRAM,
+  STR_HW_3IN1_ANOTHER,
+  STR_HW_3IN1_ERR_SLOT,
+  //
+  // snapshot messages (47)
+  STR_HW_SNAPSHOT_FAILED,
+  //
+  // restore messages (48-49)
+  STR_HW_RESTORE_NOT_STARTED,
+  STR_HW_RESTORE_READ_FAILED,
+  //
+  // backup messages (50)
+  STR_HW_BACKUP_WRITE_FAILED,
+  //
   STR_LAST
 };
 